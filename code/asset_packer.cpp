@@ -0,0 +1,367 @@
+/*
+  Offline tool that builds an asset pack (.hha) for the game.
+
+  Usage: asset_packer [--compress] <out.hha> <asset>...
+    bitmap <file.bmp>                          24 or 32 bit uncompressed bmp
+    sound <file.wav>                           16 bit pcm wav
+    font <file.bmp> <first_codepoint> <count>  monospace glyph atlas bmp
+
+  Assets get their index in the order given on the command line. With
+  --compress, assets are LZ compressed when that makes them smaller.
+*/
+
+#include "handmade_asset.h"
+#include "handmade_lz.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define internal static
+
+struct packer_file
+{
+    uint8_t *content;
+    uint32_t size;
+};
+
+struct packer_asset
+{
+    hha_asset info;
+    uint8_t *data;
+};
+
+internal packer_file read_entire_file(const char *filename)
+{
+    packer_file result {};
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        perror(filename);
+        return result;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size > 0)
+    {
+        result.content = static_cast<uint8_t*>(malloc(static_cast<size_t>(size)));
+        result.size = static_cast<uint32_t>(size);
+        if (fread(result.content, result.size, 1, file) != 1)
+        {
+            perror(filename);
+            free(result.content);
+            result = {};
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+internal uint16_t read_u16(const uint8_t *at)
+{
+    return static_cast<uint16_t>(at[0] | (at[1] << 8));
+}
+
+internal uint32_t read_u32(const uint8_t *at)
+{
+    return static_cast<uint32_t>(at[0]) | (static_cast<uint32_t>(at[1]) << 8) |
+            (static_cast<uint32_t>(at[2]) << 16) |
+            (static_cast<uint32_t>(at[3]) << 24);
+}
+
+// converts to top-down BB GG RR AA
+internal bool load_bmp(const char *filename, packer_asset *asset,
+                       uint32_t *width, uint32_t *height)
+{
+    packer_file file = read_entire_file(filename);
+    if (!file.content)
+    {
+        return false;
+    }
+    bool result = false;
+    if (file.size >= 54 && file.content[0] == 'B' && file.content[1] == 'M')
+    {
+        uint32_t pixel_offset = read_u32(file.content + 10);
+        int32_t bmp_width = static_cast<int32_t>(read_u32(file.content + 18));
+        int32_t bmp_height = static_cast<int32_t>(read_u32(file.content + 22));
+        uint16_t bits_per_pixel = read_u16(file.content + 28);
+        uint32_t compression = read_u32(file.content + 30);
+        bool top_down = bmp_height < 0;
+        uint32_t w = static_cast<uint32_t>(bmp_width);
+        uint32_t h = static_cast<uint32_t>(top_down ? -bmp_height : bmp_height);
+        uint32_t bytes_per_pixel = bits_per_pixel / 8u;
+        // BI_RGB, or BI_BITFIELDS with the default masks for 32 bit
+        uint32_t source_pitch = (w * bytes_per_pixel + 3u) & ~3u;
+        if (bmp_width > 0 && h > 0 &&
+            (bits_per_pixel == 24 || bits_per_pixel == 32) &&
+            (compression == 0 || compression == 3) &&
+            pixel_offset <= file.size &&
+            static_cast<uint64_t>(source_pitch) * h <= file.size - pixel_offset)
+        {
+            uint8_t *pixels = static_cast<uint8_t*>(malloc(w * h * 4u));
+            for (uint32_t y = 0; y < h; ++y)
+            {
+                uint32_t source_y = top_down ? y : h - 1 - y;
+                const uint8_t *source = file.content + pixel_offset +
+                        source_y * source_pitch;
+                uint8_t *dest = pixels + y * w * 4u;
+                for (uint32_t x = 0; x < w; ++x)
+                {
+                    dest[0] = source[0];
+                    dest[1] = source[1];
+                    dest[2] = source[2];
+                    dest[3] = bytes_per_pixel == 4 ? source[3] : 0xff;
+                    source += bytes_per_pixel;
+                    dest += 4;
+                }
+            }
+            asset->data = pixels;
+            asset->info.data_size = w * h * 4u;
+            asset->info.uncompressed_size = asset->info.data_size;
+            *width = w;
+            *height = h;
+            result = true;
+        }
+    }
+    if (!result)
+    {
+        fprintf(stderr, "%s: unsupported bmp\n", filename);
+    }
+    free(file.content);
+    return result;
+}
+
+internal bool load_wav(const char *filename, packer_asset *asset)
+{
+    packer_file file = read_entire_file(filename);
+    if (!file.content)
+    {
+        return false;
+    }
+    bool result = false;
+    if (file.size >= 12 && memcmp(file.content, "RIFF", 4) == 0 &&
+        memcmp(file.content + 8, "WAVE", 4) == 0)
+    {
+        uint16_t format = 0;
+        uint16_t channel_count = 0;
+        uint32_t samples_per_sec = 0;
+        uint16_t bits_per_sample = 0;
+        const uint8_t *data = nullptr;
+        uint32_t data_size = 0;
+        uint32_t offset = 12;
+        while (offset + 8 <= file.size)
+        {
+            const uint8_t *chunk = file.content + offset;
+            uint32_t chunk_size = read_u32(chunk + 4);
+            if (chunk_size > file.size - offset - 8)
+            {
+                break;
+            }
+            if (memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16)
+            {
+                format = read_u16(chunk + 8);
+                channel_count = read_u16(chunk + 10);
+                samples_per_sec = read_u32(chunk + 12);
+                bits_per_sample = read_u16(chunk + 22);
+            }
+            else if (memcmp(chunk, "data", 4) == 0)
+            {
+                data = chunk + 8;
+                data_size = chunk_size;
+            }
+            // chunks are padded to even sizes
+            offset += 8 + ((chunk_size + 1u) & ~1u);
+        }
+        if (format == 1 && bits_per_sample == 16 && channel_count > 0 && data)
+        {
+            uint32_t frame_size = channel_count * 2u;
+            data_size -= data_size % frame_size;
+            asset->data = static_cast<uint8_t*>(malloc(data_size));
+            memcpy(asset->data, data, data_size);
+            asset->info.data_size = data_size;
+            asset->info.uncompressed_size = data_size;
+            asset->info.sound.sample_count = data_size / frame_size;
+            asset->info.sound.channel_count = channel_count;
+            asset->info.sound.samples_per_sec = samples_per_sec;
+            result = true;
+        }
+    }
+    if (!result)
+    {
+        fprintf(stderr, "%s: unsupported wav\n", filename);
+    }
+    free(file.content);
+    return result;
+}
+
+// replaces the asset data with its compressed form, unless that doesn't
+// shrink it
+internal void compress_asset(packer_asset *asset, uint32_t *hash_table)
+{
+    size_t size = static_cast<size_t>(asset->info.data_size);
+    uint8_t *compressed = static_cast<uint8_t*>(malloc(lz_compress_bound(size)));
+    size_t compressed_size = lz_compress(asset->data, size, compressed,
+                                         lz_compress_bound(size), hash_table);
+    if (compressed_size && compressed_size < size)
+    {
+        free(asset->data);
+        asset->data = compressed;
+        asset->info.data_size = compressed_size;
+        asset->info.compression = hha_compression_lz;
+    }
+    else
+    {
+        free(compressed);
+    }
+}
+
+internal bool write_pack(const char *filename, const packer_asset *assets,
+                         uint32_t asset_count)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        perror(filename);
+        return false;
+    }
+
+    hha_header header {};
+    header.magic = kHhaMagic;
+    header.version = kHhaVersion;
+    header.asset_count = asset_count;
+    header.assets_offset = sizeof(hha_header);
+
+    // lay out payloads after the index
+    hha_asset *infos = static_cast<hha_asset*>(
+        calloc(asset_count ? asset_count : 1, sizeof(hha_asset)));
+    uint64_t offset = header.assets_offset + asset_count * sizeof(hha_asset);
+    for (uint32_t asset_index = 0; asset_index < asset_count; ++asset_index)
+    {
+        offset = (offset + kHhaDataAlignment - 1) & ~(kHhaDataAlignment - 1);
+        infos[asset_index] = assets[asset_index].info;
+        infos[asset_index].data_offset = offset;
+        offset += infos[asset_index].data_size;
+    }
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            (asset_count == 0 ||
+             fwrite(infos, sizeof(hha_asset), asset_count, file) == asset_count);
+    static const uint8_t zero_pad[kHhaDataAlignment] = {};
+    for (uint32_t asset_index = 0;
+         result && asset_index < asset_count;
+         ++asset_index)
+    {
+        long pad = static_cast<long>(infos[asset_index].data_offset) -
+                ftell(file);
+        result = (pad == 0 ||
+                  fwrite(zero_pad, static_cast<size_t>(pad), 1, file) == 1) &&
+                fwrite(assets[asset_index].data,
+                       static_cast<size_t>(infos[asset_index].data_size),
+                       1, file) == 1;
+    }
+    if (!result)
+    {
+        perror(filename);
+    }
+    free(infos);
+    fclose(file);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    bool compress = argc > 1 && strcmp(argv[1], "--compress") == 0;
+    int first_arg = compress ? 2 : 1;
+    if (argc <= first_arg)
+    {
+        fprintf(stderr,
+                "Usage: %s [--compress] <out.hha> <asset>...\n"
+                "  bitmap <file.bmp>\n"
+                "  sound <file.wav>\n"
+                "  font <file.bmp> <first_codepoint> <glyph_count>\n",
+                argv[0]);
+        return 1;
+    }
+
+    packer_asset *assets = static_cast<packer_asset*>(
+        calloc(static_cast<size_t>(argc), sizeof(packer_asset)));
+    uint32_t asset_count = 0;
+    bool succeeded = true;
+    const char *out_filename = argv[first_arg];
+    for (int arg_index = first_arg + 1;
+         arg_index < argc && succeeded;
+         ++arg_index)
+    {
+        const char *type = argv[arg_index];
+        packer_asset *asset = &assets[asset_count];
+        if (strcmp(type, "bitmap") == 0 && arg_index + 1 < argc)
+        {
+            asset->info.type = hha_asset_type_bitmap;
+            succeeded = load_bmp(argv[++arg_index], asset,
+                                 &asset->info.bitmap.width,
+                                 &asset->info.bitmap.height);
+        }
+        else if (strcmp(type, "sound") == 0 && arg_index + 1 < argc)
+        {
+            asset->info.type = hha_asset_type_sound;
+            succeeded = load_wav(argv[++arg_index], asset);
+        }
+        else if (strcmp(type, "font") == 0 && arg_index + 3 < argc)
+        {
+            asset->info.type = hha_asset_type_font;
+            succeeded = load_bmp(argv[arg_index + 1], asset,
+                                 &asset->info.font.width,
+                                 &asset->info.font.height);
+            asset->info.font.first_codepoint = static_cast<uint32_t>(
+                strtoul(argv[arg_index + 2], nullptr, 0));
+            asset->info.font.glyph_count = static_cast<uint32_t>(
+                strtoul(argv[arg_index + 3], nullptr, 0));
+            arg_index += 3;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown or incomplete asset: %s\n", type);
+            succeeded = false;
+        }
+        if (succeeded)
+        {
+            ++asset_count;
+        }
+    }
+
+    uint64_t uncompressed_total = 0;
+    uint64_t stored_total = 0;
+    if (succeeded && compress)
+    {
+        uint32_t *hash_table = static_cast<uint32_t*>(
+            malloc(kLzHashSize * sizeof(uint32_t)));
+        for (uint32_t asset_index = 0; asset_index < asset_count; ++asset_index)
+        {
+            compress_asset(&assets[asset_index], hash_table);
+        }
+        free(hash_table);
+    }
+    for (uint32_t asset_index = 0; asset_index < asset_count; ++asset_index)
+    {
+        uncompressed_total += assets[asset_index].info.uncompressed_size;
+        stored_total += assets[asset_index].info.data_size;
+    }
+
+    if (succeeded)
+    {
+        succeeded = write_pack(out_filename, assets, asset_count);
+    }
+    if (succeeded)
+    {
+        printf("Wrote %u assets to %s, %llu of %llu bytes\n", asset_count,
+               out_filename, static_cast<unsigned long long>(stored_total),
+               static_cast<unsigned long long>(uncompressed_total));
+    }
+    for (uint32_t asset_index = 0; asset_index < asset_count; ++asset_index)
+    {
+        free(assets[asset_index].data);
+    }
+    free(assets);
+    return succeeded ? 0 : 1;
+}
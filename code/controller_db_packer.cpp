@@ -0,0 +1,278 @@
+/*
+  Offline tool that compiles SDL's gamecontrollerdb.txt into a controller
+  mapping database (.hcdb) for one platform.
+
+  Usage: controller_db_packer <gamecontrollerdb.txt> <out.hcdb> <platform>
+    platform is as SDL_GetPlatform names it: Linux, Windows, Mac OS X...
+
+  Mappings for other platforms are left out, and mappings with no platform
+  field are kept. When a GUID shows up more than once the last mapping wins,
+  the same as adding them to SDL one after another.
+*/
+
+#include "handmade_controller_db.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define internal static
+
+struct packer_mapping
+{
+    uint8_t guid[kHcdbGuidSize];
+    const char *line;
+    uint32_t line_size;
+};
+
+internal char *read_entire_text_file(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        perror(filename);
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *result = nullptr;
+    if (size >= 0)
+    {
+        result = static_cast<char*>(malloc(static_cast<size_t>(size) + 1));
+        if (size > 0 && fread(result, static_cast<size_t>(size), 1, file) != 1)
+        {
+            perror(filename);
+            free(result);
+            result = nullptr;
+        }
+        else
+        {
+            result[size] = 0;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+internal int32_t hex_digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// the 32 hex digits a mapping line starts with, followed by a comma
+internal bool parse_guid(const char *line, uint32_t line_size, uint8_t *guid)
+{
+    if (line_size <= kHcdbGuidSize * 2 || line[kHcdbGuidSize * 2] != ',')
+    {
+        return false;
+    }
+    for (uint32_t byte_index = 0; byte_index < kHcdbGuidSize; ++byte_index)
+    {
+        int32_t high = hex_digit_value(line[byte_index * 2]);
+        int32_t low = hex_digit_value(line[byte_index * 2 + 1]);
+        if (high < 0 || low < 0)
+        {
+            return false;
+        }
+        guid[byte_index] = static_cast<uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+// true for lines meant for platform and lines without a platform field
+internal bool is_for_platform(const char *line, uint32_t line_size,
+                              const char *platform)
+{
+    const char kPlatformField[] = "platform:";
+    size_t field_size = sizeof(kPlatformField) - 1;
+    size_t platform_size = strlen(platform);
+    for (uint32_t at = 0; at + field_size <= line_size; ++at)
+    {
+        if ((at == 0 || line[at - 1] == ',') &&
+            memcmp(line + at, kPlatformField, field_size) == 0)
+        {
+            const char *value = line + at + field_size;
+            size_t value_size = 0;
+            while (at + field_size + value_size < line_size &&
+                   value[value_size] != ',')
+            {
+                ++value_size;
+            }
+            return value_size == platform_size &&
+                    memcmp(value, platform, platform_size) == 0;
+        }
+    }
+    return true;
+}
+
+internal bool write_database(const char *filename, const char *platform,
+                             const packer_mapping *mappings,
+                             uint32_t mapping_count)
+{
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        perror(filename);
+        return false;
+    }
+
+    hcdb_header header {};
+    header.magic = kHcdbMagic;
+    header.version = kHcdbVersion;
+    strncpy(header.platform, platform, kHcdbPlatformSize - 1);
+    header.entry_count = mapping_count;
+    header.bucket_count = 1;
+    while (header.bucket_count < mapping_count * 2)
+    {
+        header.bucket_count *= 2;
+    }
+    header.buckets_offset = sizeof(hcdb_header);
+    header.entries_offset = header.buckets_offset +
+            header.bucket_count * static_cast<uint32_t>(sizeof(uint32_t));
+
+    uint32_t *buckets = static_cast<uint32_t*>(
+        calloc(header.bucket_count, sizeof(uint32_t)));
+    hcdb_entry *entries = static_cast<hcdb_entry*>(
+        calloc(mapping_count ? mapping_count : 1, sizeof(hcdb_entry)));
+    uint32_t mapping_offset = header.entries_offset +
+            mapping_count * static_cast<uint32_t>(sizeof(hcdb_entry));
+    uint32_t mask = header.bucket_count - 1;
+    for (uint32_t mapping_index = 0;
+         mapping_index < mapping_count;
+         ++mapping_index)
+    {
+        const packer_mapping *mapping = &mappings[mapping_index];
+        hcdb_entry *entry = &entries[mapping_index];
+        memcpy(entry->guid, mapping->guid, kHcdbGuidSize);
+        entry->mapping_offset = mapping_offset;
+        entry->mapping_size = mapping->line_size;
+        mapping_offset += mapping->line_size + 1;
+
+        uint32_t bucket = hcdb_hash_guid(mapping->guid) & mask;
+        while (buckets[bucket])
+        {
+            bucket = (bucket + 1) & mask;
+        }
+        buckets[bucket] = mapping_index + 1;
+    }
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(buckets, sizeof(uint32_t), header.bucket_count, file) ==
+            header.bucket_count &&
+            (mapping_count == 0 ||
+             fwrite(entries, sizeof(hcdb_entry), mapping_count, file) ==
+             mapping_count);
+    for (uint32_t mapping_index = 0;
+         result && mapping_index < mapping_count;
+         ++mapping_index)
+    {
+        result = fwrite(mappings[mapping_index].line,
+                        mappings[mapping_index].line_size, 1, file) == 1 &&
+                fputc(0, file) == 0;
+    }
+    if (!result)
+    {
+        perror(filename);
+    }
+    free(entries);
+    free(buckets);
+    fclose(file);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4)
+    {
+        fprintf(stderr,
+                "Usage: %s <gamecontrollerdb.txt> <out.hcdb> <platform>\n",
+                argv[0]);
+        return 1;
+    }
+    const char *platform = argv[3];
+    if (strlen(platform) >= kHcdbPlatformSize)
+    {
+        fprintf(stderr, "Platform name too long: %s\n", platform);
+        return 1;
+    }
+    char *text = read_entire_text_file(argv[1]);
+    if (!text)
+    {
+        return 1;
+    }
+
+    // at most one mapping a line
+    uint32_t line_count = 1;
+    for (const char *at = text; *at; ++at)
+    {
+        line_count += *at == '\n';
+    }
+    packer_mapping *mappings = static_cast<packer_mapping*>(
+        calloc(line_count, sizeof(packer_mapping)));
+    uint32_t mapping_count = 0;
+    uint32_t skipped_count = 0;
+    for (char *line = text; *line;)
+    {
+        char *line_end = line;
+        while (*line_end && *line_end != '\n')
+        {
+            ++line_end;
+        }
+        char *next_line = *line_end ? line_end + 1 : line_end;
+        while (line_end > line &&
+               (line_end[-1] == '\r' || line_end[-1] == ' '))
+        {
+            --line_end;
+        }
+        uint32_t line_size = static_cast<uint32_t>(line_end - line);
+        packer_mapping mapping {};
+        if (line_size && line[0] != '#' &&
+            parse_guid(line, line_size, mapping.guid))
+        {
+            if (is_for_platform(line, line_size, platform))
+            {
+                mapping.line = line;
+                mapping.line_size = line_size;
+                // a later mapping for the same GUID replaces the earlier one
+                uint32_t mapping_index = 0;
+                while (mapping_index < mapping_count &&
+                       memcmp(mappings[mapping_index].guid, mapping.guid,
+                              kHcdbGuidSize) != 0)
+                {
+                    ++mapping_index;
+                }
+                mappings[mapping_index] = mapping;
+                mapping_count += mapping_index == mapping_count;
+            }
+            else
+            {
+                ++skipped_count;
+            }
+        }
+        line = next_line;
+    }
+
+    bool succeeded = write_database(argv[2], platform, mappings,
+                                    mapping_count);
+    if (succeeded)
+    {
+        printf("Wrote %u %s mappings to %s, skipped %u for other platforms\n",
+               mapping_count, platform, argv[2], skipped_count);
+    }
+    free(mappings);
+    free(text);
+    return succeeded ? 0 : 1;
+}
@@ -1,9 +1,15 @@
 #include "handmade.h"
+#include "handmade_asset.cpp"
+#include "handmade_profiler.cpp"
 
-internal void game_output_sound(game_sound_buffer *sound_buffer, real32 tone_hz)
+internal void game_output_sound(game_sound_buffer *sound_buffer,
+                               real32 tone_hz, real32 *sine_t_ptr)
 {
+    TIMED_BLOCK("game_output_sound");
     // Just do a sine wave
-    local_persist real32 sine_t = 0.0f;
+    // sine t is the running phase; it moves on by however many samples the
+    // audio cursor asks for, so input playback doesn't reproduce it
+    real32 sine_t = *sine_t_ptr;
     int16_t tone_volume = 1000;
     real32 wave_period_sample_count =
             static_cast<real32>(sound_buffer->samples_per_sec) / tone_hz;
@@ -26,14 +32,20 @@ internal void game_output_sound(game_sound_buffer *sound_buffer, real32 tone_hz)
             sine_t -= 2.0f * kPiReal32;
         }
     }
+    *sine_t_ptr = sine_t;
 }
 
+// the frame is split into this many bands of rows for the job system
+constexpr int32_t kRenderBandCount = 16;
+
 internal void render_weird_gradient(game_offscreen_buffer *buffer,
-                                    int32_t blue_offset, int32_t green_offset)
+                                    int32_t blue_offset, int32_t green_offset,
+                                    int32_t min_y, int32_t max_y)
 {
     // draw something
-    uint8_t *row = static_cast<uint8_t*>(buffer->memory);
-    for (int32_t y = 0; y < buffer->height; ++y)
+    uint8_t *row = static_cast<uint8_t*>(buffer->memory) +
+            min_y * buffer->pitch;
+    for (int32_t y = min_y; y < max_y; ++y)
     {
         uint32_t *pixel = reinterpret_cast<uint32_t*>(row);
         for (int32_t x = 0; x < buffer->width; ++x)
@@ -58,30 +70,76 @@ internal void render_weird_gradient(game_offscreen_buffer *buffer,
     }
 }
 
-internal void game_update_and_render(game_memory *memory,
-                                     game_offscreen_buffer *buffer,
-                                     game_sound_buffer *sound_buffer,
-                                     const game_input *input)
+struct render_gradient_work
+{
+    game_offscreen_buffer *buffer;
+    int32_t blue_offset;
+    int32_t green_offset;
+    int32_t min_y;
+    int32_t max_y;
+};
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(do_render_gradient_work)
+{
+    (void)queue;
+    TIMED_BLOCK("render_gradient_band");
+    render_gradient_work *work = static_cast<render_gradient_work*>(data);
+    render_weird_gradient(work->buffer, work->blue_offset, work->green_offset,
+                          work->min_y, work->max_y);
+}
+
+internal void draw_bitmap(game_offscreen_buffer *buffer,
+                          const asset_slot *bitmap, int32_t x, int32_t y)
+{
+    TIMED_BLOCK("draw_bitmap");
+    const hha_bitmap *info = &bitmap->info->bitmap;
+    int32_t min_x = std::max(x, 0);
+    int32_t min_y = std::max(y, 0);
+    int32_t max_x = std::min(x + static_cast<int32_t>(info->width),
+                             buffer->width);
+    int32_t max_y = std::min(y + static_cast<int32_t>(info->height),
+                             buffer->height);
+    if (min_x >= max_x || min_y >= max_y)
+    {
+        return;
+    }
+    ptrdiff_t source_pitch = static_cast<ptrdiff_t>(info->width) * 4;
+    const uint8_t *source_row = static_cast<const uint8_t*>(bitmap->memory) +
+            (min_y - y) * source_pitch + (min_x - x) * 4;
+    uint8_t *dest_row = static_cast<uint8_t*>(buffer->memory) +
+            min_y * buffer->pitch + min_x * 4;
+    for (int32_t row = min_y; row < max_y; ++row)
+    {
+        std::memcpy(dest_row, source_row,
+                    static_cast<size_t>(max_x - min_x) * 4);
+        source_row += source_pitch;
+        dest_row += buffer->pitch;
+    }
+}
+
+// offsets move this many pixels a second, what they used to move a frame
+// at 60Hz before the game knew its frame period
+constexpr real32 kStickBlueSpeed = 600.0f;
+constexpr real32 kStickGreenSpeed = 300.0f;
+constexpr real32 kButtonSpeed = 60.0f;
+
+internal game_state *get_game_state(game_memory *memory)
 {
-    // ptr arithmethic is based on element size, so this works
-    HANDMADE_ASSERT((&input->controllers[0].terminator -
-                     &input->controllers[0].buttons[0]) ==
-                    static_cast<ptrdiff_t>(
-                        array_length(input->controllers[0].buttons)));
     HANDMADE_ASSERT(sizeof(game_state) <= memory->permanent_storage_size);
-        
     game_state *state =
             static_cast<game_state*>(memory->permanent_storage);
     if (!memory->is_initialized)
     {
         const char *filename = __FILE__;
-        debug_read_file_result read_result =
-                debug_platform_read_entire_file(filename);
-        if (read_result.content)
+        platform_file_view file = platform_map_file(filename, true);
+        if (file.content)
         {
-            debug_platform_write_entire_file("test.out", read_result.content,
-                                             read_result.size);
-            debug_platform_free_file_memory(&read_result);
+#if HANDMADE_INTERNAL_BUILD
+            debug_platform_write_entire_file(
+                "test.out", const_cast<void*>(file.content),
+                safe_truncate_uint64_uint32(file.size));
+#endif // HANDMADE_INTERNAL_BUILD
+            platform_unmap_file(&file);
         }
         
         // memory is already zeroed
@@ -90,6 +148,30 @@ internal void game_update_and_render(game_memory *memory,
         state->tone_hz = 256.0f;
         memory->is_initialized = true;
     }
+    return state;
+}
+
+// only the low 8 bits of an offset show, so both copies move back by the same
+// multiple of 256 to keep the floats small without a visible jump
+internal void wrap_gradient_offset(real32 *offset, real32 *prev_offset)
+{
+    real32 wrap = 256.0f * std::floor(*offset / 256.0f);
+    *offset -= wrap;
+    *prev_offset -= wrap;
+}
+
+internal void game_update(game_memory *memory, const game_input *input)
+{
+    TIMED_BLOCK("game_update");
+    // ptr arithmethic is based on element size, so this works
+    HANDMADE_ASSERT((&input->controllers[0].terminator -
+                     &input->controllers[0].buttons[0]) ==
+                    static_cast<ptrdiff_t>(
+                        array_length(input->controllers[0].buttons)));
+    game_state *state = get_game_state(memory);
+    state->prev_blue_offset = state->blue_offset;
+    state->prev_green_offset = state->green_offset;
+    real32 dt = input->dt_for_frame;
 
     for (int controller_index = 0;
          controller_index < game_input::max_controller_count;
@@ -100,20 +182,26 @@ internal void game_update_and_render(game_memory *memory,
         if (controller->is_analog)
         {
             state->tone_hz = 256.0f + 128.0f * controller->right_stick.avg_y;
-            state->blue_offset -= static_cast<int>(
-                controller->left_stick.avg_x * 10.0f);
-            state->green_offset += static_cast<int>(
-                controller->left_stick.avg_y * 5.0f);
+            state->blue_offset -=
+                    controller->left_stick.avg_x * kStickBlueSpeed * dt;
+            state->green_offset +=
+                    controller->left_stick.avg_y * kStickGreenSpeed * dt;
         }
         else
         {
-            state->blue_offset += controller->move_left.ended_down;
-            state->blue_offset -= controller->move_right.ended_down;
+            if (controller->move_left.ended_down)
+            {
+                state->blue_offset += kButtonSpeed * dt;
+            }
+            if (controller->move_right.ended_down)
+            {
+                state->blue_offset -= kButtonSpeed * dt;
+            }
         }
 
         if (controller->action_down.ended_down)
         {
-            state->green_offset += 1;
+            state->green_offset += kButtonSpeed * dt;
         }
         // if (left_stick_x > kEpsilonReal32 || left_stick_x < -kEpsilonReal32)
         // {
@@ -145,9 +233,98 @@ internal void game_update_and_render(game_memory *memory,
         //     XInputSetState(controller_index, &vibration);
         // }
     }
-    
+
+    wrap_gradient_offset(&state->blue_offset, &state->prev_blue_offset);
+    wrap_gradient_offset(&state->green_offset, &state->prev_green_offset);
+}
+
+internal void game_render(game_memory *memory, game_offscreen_buffer *buffer,
+                          game_sound_buffer *sound_buffer, real32 alpha)
+{
+    TIMED_BLOCK("game_render");
+    game_state *state = get_game_state(memory);
+    HANDMADE_ASSERT(sizeof(transient_state) <= memory->transient_storage_size);
+    transient_state *tran_state =
+            static_cast<transient_state*>(memory->transient_storage);
+    if (!tran_state->is_initialized)
+    {
+        init_arena(&tran_state->arena,
+                   static_cast<uint8_t*>(memory->transient_storage) +
+                   sizeof(transient_state),
+                   memory->transient_storage_size - sizeof(transient_state));
+        // "level load": queue everything in the pack up front, the loader
+        // thread streams it in over the next frames
+        if (load_asset_pack(&tran_state->assets, &tran_state->arena,
+                            kAssetPackFile, memory->asset_memory_budget))
+        {
+            for (uint32_t asset_index = 0;
+                 asset_index < tran_state->assets.asset_count;
+                 ++asset_index)
+            {
+                request_asset(&tran_state->assets, asset_index);
+            }
+        }
+        tran_state->is_initialized = true;
+    }
+    begin_asset_frame(&tran_state->assets);
+
+    int32_t blue_offset = static_cast<int32_t>(std::floor(
+        state->prev_blue_offset +
+        (state->blue_offset - state->prev_blue_offset) * alpha));
+    int32_t green_offset = static_cast<int32_t>(std::floor(
+        state->prev_green_offset +
+        (state->green_offset - state->prev_green_offset) * alpha));
+
     // TODO: allow sample offsets here for more robust platform options
-    game_output_sound(sound_buffer, state->tone_hz);
-    render_weird_gradient(buffer, state->blue_offset,
-                          state->green_offset);
+    game_output_sound(sound_buffer, state->tone_hz, &state->sine_t);
+    // bands are independent, so they go wide
+    {
+        TIMED_BLOCK("render_gradient");
+        render_gradient_work render_work[kRenderBandCount];
+        int32_t band_height = (buffer->height + kRenderBandCount - 1) /
+                kRenderBandCount;
+        for (int32_t band_index = 0;
+             band_index < kRenderBandCount;
+             ++band_index)
+        {
+            render_gradient_work *work = &render_work[band_index];
+            work->buffer = buffer;
+            work->blue_offset = blue_offset;
+            work->green_offset = green_offset;
+            work->min_y = std::min(band_index * band_height, buffer->height);
+            work->max_y = std::min(work->min_y + band_height, buffer->height);
+            platform_add_entry(memory->work_queue, do_render_gradient_work,
+                               work);
+        }
+        platform_complete_all_work(memory->work_queue);
+    }
+
+    // the first bitmap is kept hot in the cache, anything else that was
+    // loaded is free to be evicted
+    for (uint32_t asset_index = 0;
+         asset_index < tran_state->assets.asset_count;
+         ++asset_index)
+    {
+        if (tran_state->assets.infos[asset_index].type == hha_asset_type_bitmap)
+        {
+            const asset_slot *bitmap = get_asset(&tran_state->assets,
+                                                 asset_index,
+                                                 hha_asset_type_bitmap);
+            if (bitmap)
+            {
+                draw_bitmap(buffer, bitmap, 10, 10);
+            }
+            break;
+        }
+    }
+}
+
+internal void game_update_and_render(game_memory *memory,
+                                     game_offscreen_buffer *buffer,
+                                     game_sound_buffer *sound_buffer,
+                                     const game_input *input)
+{
+    TIMED_BLOCK("game_update_and_render");
+    game_update(memory, input);
+    game_render(memory, buffer, sound_buffer, 1.0f);
 }
@@ -9,11 +9,17 @@
 //   0 - build for internal development
 //   1 - build for public release
 //
+// HANDMADE_ALLOC_CHECK:
+//   0 - no allocation tracking
+//   1 - count every allocation and report the ones made in the steady state
+//       frame loop with a backtrace (platform layer only)
+//
 
 #include <cstddef>
 #include <cstdint>
 #include <cinttypes>
 #include <cmath>
+#include <cstring>
 
 #include <utility>
 #include <algorithm>
@@ -118,10 +124,203 @@ inline uint8_t safe_truncate_uint32_uint8(uint32_t val)
     return result;
 }
 
+#include "handmade_cpu.h"
+
 /*
   Services that the platform layer provides to the game.
 */
 
+// Read only view of a whole file mapped into memory. No copy is made, pages
+// are brought in from the file cache as they are touched. Empty or missing
+// files give a view with null content.
+struct platform_file_view
+{
+    const void *content;
+    uint64_t size;
+};
+// prefetch asks the os to start reading the whole file in ahead of use
+internal platform_file_view platform_map_file(const char *filename,
+                                              bool32 prefetch);
+internal void platform_unmap_file(platform_file_view *view);
+
+// Background loading. Loads run in order on a loader thread; when one is done
+// its data pointer is published through a lock-free queue that the game
+// drains with platform_pop_completed_load. Both must only be called from the
+// game update thread. platform_push_load returns false when the queue is full.
+#define PLATFORM_LOAD_PROC(name) void name(void *data)
+typedef PLATFORM_LOAD_PROC(platform_load_proc);
+internal bool32 platform_push_load(platform_load_proc *proc, void *data);
+internal bool32 platform_pop_completed_load(void **data);
+
+// Job system. Entries added to a work queue may run on any core, the platform
+// keeps one worker thread per core and idle threads steal work from busy
+// ones. Callbacks may add more entries to the queue they run on.
+// platform_complete_all_work also runs entries on the calling thread until
+// every entry added so far has finished; only call it from the game update
+// thread, never from inside a callback.
+struct platform_work_queue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) \
+    void name(platform_work_queue *queue, void *data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+internal void platform_add_entry(platform_work_queue *queue,
+                                 platform_work_queue_callback *callback,
+                                 void *data);
+internal void platform_complete_all_work(platform_work_queue *queue);
+
+struct platform_work_queue_stats
+{
+    uint64_t jobs_executed;
+    uint64_t jobs_stolen;  // run by a thread other than the one that added it
+};
+internal platform_work_queue_stats platform_get_work_queue_stats(
+    platform_work_queue *queue);
+
+// Timing. Everything is timed with one counter: the TSC when it runs at a
+// constant rate, otherwise the os monotonic clock in nanoseconds. The
+// platform calibrates it at startup with calibrate_timer, or in two halves to
+// keep the spin off the startup path; tick deltas convert with ticks_to_ns and
+// ticks_to_ms.
+struct timer_info
+{
+    bool32 uses_tsc;
+    uint64_t ticks_per_sec;
+    // ns = ticks * ns_mult >> ns_shift, with ns_mult kept below 2^32
+    uint64_t ns_mult;
+    uint32_t ns_shift;
+};
+internal uint64_t platform_read_os_clock_ns();
+
+inline uint64_t read_timer(const timer_info *timer)
+{
+    return timer->uses_tsc ? read_tsc() : platform_read_os_clock_ns();
+}
+
+inline uint64_t ticks_to_ns(const timer_info *timer, uint64_t ticks)
+{
+    // in two halves so the product can't overflow
+    uint64_t high = ticks >> 32;
+    uint64_t low = ticks & 0xffffffff;
+    return ((high * timer->ns_mult) << (32 - timer->ns_shift)) +
+            ((low * timer->ns_mult) >> timer->ns_shift);
+}
+
+inline real32 ticks_to_ms(const timer_info *timer, uint64_t ticks)
+{
+    return static_cast<real32>(ticks_to_ns(timer, ticks)) / 1000000.0f;
+}
+
+// the tsc against the os clock, read a few times and kept from the read the
+// clock brackets tightest, so a preemption in the middle doesn't skew it
+inline void sample_tsc_against_os_clock(uint64_t *tsc, uint64_t *ns)
+{
+    uint64_t best_window = UINT64_MAX;
+    for (int32_t try_index = 0; try_index < 8; ++try_index)
+    {
+        uint64_t before = platform_read_os_clock_ns();
+        uint64_t sample_tsc = read_tsc();
+        uint64_t after = platform_read_os_clock_ns();
+        if (after - before < best_window)
+        {
+            best_window = after - before;
+            *tsc = sample_tsc;
+            *ns = before + best_window / 2;
+        }
+    }
+}
+
+inline void set_timer_rate(timer_info *timer, uint64_t ticks_per_sec)
+{
+    constexpr uint64_t kNsPerSec = 1000000000ULL;
+    timer->ticks_per_sec = ticks_per_sec;
+    timer->ns_shift = 32;
+    while ((kNsPerSec << timer->ns_shift) / timer->ticks_per_sec >
+           0xffffffffULL)
+    {
+        --timer->ns_shift;
+    }
+    timer->ns_mult = (kNsPerSec << timer->ns_shift) / timer->ticks_per_sec;
+}
+
+// Calibration takes two samples about 20ms apart. begin_timer_calibration
+// takes the first and leaves the timer on the os clock; the platform can do
+// useful work before end_timer_calibration takes the second, which only spins
+// for whatever is left of the 20ms, and moves the timer onto the tsc.
+struct timer_calibration
+{
+    bool32 has_invariant_tsc;
+    uint64_t start_tsc;
+    uint64_t start_ns;
+    uint64_t end_tsc;
+    uint64_t end_ns;
+};
+
+inline void begin_timer_calibration(timer_info *timer,
+                                    timer_calibration *calibration,
+                                    const cpu_info *cpu)
+{
+    constexpr uint64_t kNsPerSec = 1000000000ULL;
+    *timer = {};
+    set_timer_rate(timer, kNsPerSec);
+    *calibration = {};
+    calibration->has_invariant_tsc = cpu->has_invariant_tsc;
+    if (calibration->has_invariant_tsc)
+    {
+        sample_tsc_against_os_clock(&calibration->start_tsc,
+                                    &calibration->start_ns);
+    }
+}
+
+inline void end_timer_calibration(timer_info *timer,
+                                  timer_calibration *calibration)
+{
+    constexpr uint64_t kNsPerSec = 1000000000ULL;
+    constexpr uint64_t kCalibrationNs = 20000000ULL;
+    if (calibration->has_invariant_tsc)
+    {
+        while (platform_read_os_clock_ns() - calibration->start_ns <
+               kCalibrationNs)
+        {
+        }
+        sample_tsc_against_os_clock(&calibration->end_tsc,
+                                    &calibration->end_ns);
+        if (calibration->end_ns > calibration->start_ns &&
+            calibration->end_tsc > calibration->start_tsc)
+        {
+            timer->uses_tsc = true;
+            set_timer_rate(timer,
+                           (calibration->end_tsc - calibration->start_tsc) *
+                           kNsPerSec /
+                           (calibration->end_ns - calibration->start_ns));
+        }
+    }
+}
+
+// a counter read on the os clock before end_timer_calibration, as the timer
+// would have read it at the same moment after
+inline uint64_t rebase_os_clock_ticks(const timer_info *timer,
+                                      const timer_calibration *calibration,
+                                      uint64_t os_clock_ns)
+{
+    if (!timer->uses_tsc)
+    {
+        return os_clock_ns;
+    }
+    constexpr uint64_t kNsPerSec = 1000000000ULL;
+    uint64_t ticks_ago = (calibration->end_ns - os_clock_ns) *
+            timer->ticks_per_sec / kNsPerSec;
+    return calibration->end_tsc - ticks_ago;
+}
+
+// spins for about 20ms measuring the TSC against the os clock
+inline void calibrate_timer(timer_info *timer, const cpu_info *cpu)
+{
+    timer_calibration calibration;
+    begin_timer_calibration(timer, &calibration, cpu);
+    end_timer_calibration(timer, &calibration);
+}
+
+#include "handmade_profiler.h"
+
 #if HANDMADE_INTERNAL_BUILD
 struct debug_read_file_result
 {
@@ -219,11 +418,60 @@ struct game_controller_input
     };
 };
 
+enum game_input_event_type : uint8_t
+{
+    game_input_event_button,
+    game_input_event_axis,
+};
+
+enum game_input_axis : uint8_t
+{
+    game_input_axis_left_x,
+    game_input_axis_left_y,
+    game_input_axis_right_x,
+    game_input_axis_right_y,
+};
+
+// One button or stick change, for what num_half_transition can't tell: when
+// in the frame it happened and in which order.
+struct game_input_event
+{
+    // seconds after the input the previous game update saw was read, 0 if
+    // not known; frame relative, so with fixed steps it's up to the game to
+    // place it within its step
+    real32 time;
+    // 1 or 0 for buttons, the stick value after its deadzone for axes
+    real32 value;
+    uint8_t controller_index;
+    game_input_event_type type;
+    // index into game_controller_input::buttons or a game_input_axis
+    uint8_t id;
+};
+
 struct game_input
 {
     class_scope constexpr int32_t kbd_controller_index = 0;
     class_scope constexpr int32_t max_controller_count = 5;
+    class_scope constexpr uint32_t max_event_count = 64;
     game_controller_input controllers[max_controller_count];
+    // seconds each game update stands for, the target frame period rather
+    // than how long the last frame actually took
+    real32 dt_for_frame;
+
+    // platform timer ticks (read_timer) for latency tracking, not gameplay:
+    // when controllers were read, and the earliest input that changed each
+    // controller this frame, 0 if none did
+    uint64_t sample_counter;
+    uint64_t change_counters[max_controller_count];
+
+    // every change since the previous game update in the order it happened,
+    // on top of the state above; the ones past max_event_count are only
+    // counted. Like transitions, they wait for the next update over frames
+    // that run none. Left empty by platform layers without timestamped
+    // input and by recording playback.
+    uint32_t event_count;
+    uint32_t dropped_event_count;
+    game_input_event events[max_event_count];
 };
 
 inline game_controller_input *get_controller(game_input *input, int index)
@@ -241,6 +489,230 @@ inline const game_controller_input *get_controller(const game_input *input,
     return result;
 }
 
+// Input helpers shared by the platform layers.
+
+inline void push_input_event(game_input *input, game_input_event_type type,
+                             int32_t controller_index, uint32_t id,
+                             real32 value, real32 time)
+{
+    if (input->event_count == game_input::max_event_count)
+    {
+        ++input->dropped_event_count;
+        return;
+    }
+    game_input_event *event = &input->events[input->event_count++];
+    event->time = time;
+    event->value = value;
+    event->controller_index = static_cast<uint8_t>(controller_index);
+    event->type = type;
+    event->id = static_cast<uint8_t>(id);
+}
+
+inline void clear_input_events(game_input *input)
+{
+    input->event_count = 0;
+    input->dropped_event_count = 0;
+}
+
+// events no game update has seen yet stay queued in the next frame's input
+inline void carry_input_events(game_input *new_input,
+                               const game_input *old_input)
+{
+    new_input->event_count = old_input->event_count;
+    new_input->dropped_event_count = old_input->dropped_event_count;
+    for (uint32_t event_index = 0;
+         event_index < old_input->event_count;
+         ++event_index)
+    {
+        new_input->events[event_index] = old_input->events[event_index];
+    }
+}
+
+// once a game update has seen them, so the next update only gets the
+// transitions and events that came after; until then they keep adding up,
+// so none are lost on frames that run no update
+inline void consume_input_transitions(game_input *input)
+{
+    clear_input_events(input);
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        game_controller_input *controller =
+                get_controller(input, controller_index);
+        for (uint32_t button_index = 0;
+             button_index < array_length(controller->buttons);
+             ++button_index)
+        {
+            controller->buttons[button_index].num_half_transition = 0;
+        }
+    }
+}
+
+// raw stick axis value, max_val at full tilt, to -1..1 with the deadzone
+// (normalized) cut out and the rest scaled back up to the full range
+inline real32 resolve_stick_deadzone(real32 val, real32 max_val,
+                                     real32 deadzone)
+{
+    // max with -1 because abs(min val) is 1 greater than max val
+    val = std::max(-1.0f, val / max_val);
+    if (val >= 0.0f)
+    {
+        val = val < deadzone ? 0.0f : val - deadzone;
+    }
+    else
+    {
+        val = val > -deadzone ? 0.0f : val + deadzone;
+    }
+    val /= (1.0f - deadzone);
+    return val;
+}
+
+// button state from whether it's down this frame and last frame's state
+inline void process_digital_button(game_button_state *new_state,
+                                   const game_button_state *old_state,
+                                   bool32 is_down)
+{
+    new_state->ended_down = is_down;
+    int32_t transition_amount = (old_state->ended_down != is_down) ? 1 : 0;
+    new_state->num_half_transition =
+            old_state->num_half_transition + transition_amount;
+}
+
+// Packed controller state, for storing and replaying many frames of input:
+// one ended_down bit per button, with transitions left out since a frame's
+// come from XOR with the frame before. 20 bytes instead of 128.
+constexpr uint16_t kPackedControllerConnected = 1 << 0;
+constexpr uint16_t kPackedControllerAnalog = 1 << 1;
+
+struct game_packed_controller
+{
+    uint16_t ended_down_mask;
+    uint16_t flags;
+    game_analog_stick_state left_stick;
+    game_analog_stick_state right_stick;
+};
+
+struct game_packed_input
+{
+    game_packed_controller controllers[game_input::max_controller_count];
+};
+
+static_assert(sizeof(game_controller_input::buttons) <=
+              16 * sizeof(game_button_state),
+              "ended_down_mask must have a bit per button");
+
+inline uint16_t get_ended_down_mask(const game_controller_input *controller)
+{
+    uint32_t mask = 0;
+    for (uint32_t button_index = 0;
+         button_index < array_length(controller->buttons);
+         ++button_index)
+    {
+        mask |= (controller->buttons[button_index].ended_down ? 1u : 0u) <<
+                button_index;
+    }
+    return static_cast<uint16_t>(mask);
+}
+
+inline void pack_input(game_packed_input *packed, const game_input *input)
+{
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        const game_controller_input *controller =
+                get_controller(input, controller_index);
+        game_packed_controller *dest = &packed->controllers[controller_index];
+        dest->ended_down_mask = get_ended_down_mask(controller);
+        dest->flags = static_cast<uint16_t>(
+            (controller->is_connected ? kPackedControllerConnected : 0) |
+            (controller->is_analog ? kPackedControllerAnalog : 0));
+        dest->left_stick = controller->left_stick;
+        dest->right_stick = controller->right_stick;
+    }
+}
+
+// every button of every controller from first_controller_index on, from one
+// ended_down mask per controller: the batch version of process_digital_button
+inline void process_button_masks(
+    game_input *new_input, const game_input *old_input,
+    const uint16_t down_masks[game_input::max_controller_count],
+    int32_t first_controller_index)
+{
+    for (int32_t controller_index = first_controller_index;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        game_controller_input *new_controller =
+                get_controller(new_input, controller_index);
+        const game_controller_input *old_controller =
+                get_controller(old_input, controller_index);
+        uint32_t down_mask = down_masks[controller_index];
+        // branch free, so the compiler can do the buttons side by side
+        for (uint32_t button_index = 0;
+             button_index < array_length(new_controller->buttons);
+             ++button_index)
+        {
+            uint32_t is_down = (down_mask >> button_index) & 1;
+            uint32_t was_down = static_cast<uint32_t>(
+                old_controller->buttons[button_index].ended_down != 0);
+            new_controller->buttons[button_index].ended_down =
+                    static_cast<bool32>(is_down);
+            new_controller->buttons[button_index].num_half_transition =
+                    old_controller->buttons[button_index].num_half_transition +
+                    static_cast<int32_t>(is_down ^ was_down);
+        }
+    }
+}
+
+// controllers of input from a packed frame; transitions are the ones between
+// prev and packed, so each button has at most one
+inline void unpack_input(game_input *input, const game_packed_input *packed,
+                         const game_packed_input *prev)
+{
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        const game_packed_controller *source =
+                &packed->controllers[controller_index];
+        game_controller_input *controller =
+                get_controller(input, controller_index);
+        uint32_t down_mask = source->ended_down_mask;
+        uint32_t transition_mask = down_mask ^
+                prev->controllers[controller_index].ended_down_mask;
+        controller->is_connected =
+                (source->flags & kPackedControllerConnected) != 0;
+        controller->is_analog = (source->flags & kPackedControllerAnalog) != 0;
+        controller->left_stick = source->left_stick;
+        controller->right_stick = source->right_stick;
+        for (uint32_t button_index = 0;
+             button_index < array_length(controller->buttons);
+             ++button_index)
+        {
+            controller->buttons[button_index].ended_down =
+                    (down_mask >> button_index) & 1;
+            controller->buttons[button_index].num_half_transition =
+                    static_cast<int32_t>((transition_mask >> button_index) & 1);
+        }
+    }
+}
+
+// the game doesn't need to update faster than this
+constexpr uint32_t kMaxGameUpdateHz = 75;
+
+// how many vblanks each game frame is shown for: 1, or 2 or 3 on displays
+// too fast to update the game every refresh
+inline uint32_t get_vblanks_per_game_update(uint32_t refresh_hz)
+{
+    uint32_t vblanks = 1;
+    while (vblanks < 3 && refresh_hz > kMaxGameUpdateHz * vblanks)
+    {
+        ++vblanks;
+    }
+    return vblanks;
+}
 
 struct game_memory
 {
@@ -250,8 +722,25 @@ struct game_memory
     uint64_t permanent_storage_size;
     void *transient_storage;  // required to be cleared to 0 at startup
     uint64_t transient_storage_size;
+
+    // part of transient storage assets are cached in, 0 for the default
+    uint64_t asset_memory_budget;
+
+    platform_work_queue *work_queue;
+
+    // what the cpu running the game can do, filled in once at startup
+    cpu_info cpu;
+    timer_info timer;
 };
 
+// one simulation step of input->dt_for_frame seconds; platforms running a
+// fixed timestep call it as many times as a frame needs, even none
+internal void game_update(game_memory *memory, const game_input *input);
+// draws and outputs sound for the state alpha (0..1) of the way from the
+// step before the last game_update to the last one
+internal void game_render(game_memory *memory, game_offscreen_buffer *buffer,
+                          game_sound_buffer *sound_buffer, real32 alpha);
+// a game_update and a game_render of it, for one update a frame
 internal void game_update_and_render(game_memory *memory,
                                      game_offscreen_buffer *buffer,
                                      game_sound_buffer *sound_buffer,
@@ -260,9 +749,109 @@ internal void game_update_and_render(game_memory *memory,
 /*
  */
 
+#include "handmade_asset.h"
+
+struct memory_arena
+{
+    uint8_t *base;
+    uint64_t size;
+    uint64_t used;
+};
+
+inline void init_arena(memory_arena *arena, void *base, uint64_t size)
+{
+    arena->base = static_cast<uint8_t*>(base);
+    arena->size = size;
+    arena->used = 0;
+}
+
+inline void *push_size(memory_arena *arena, uint64_t size,
+                       uint64_t alignment = 16)
+{
+    uint64_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+    HANDMADE_ASSERT(offset + size <= arena->size);
+    void *result = arena->base + offset;
+    arena->used = offset + size;
+    return result;
+}
+
+template<typename T>
+inline T *push_array(memory_arena *arena, uint64_t count)
+{
+    return static_cast<T*>(push_size(arena, sizeof(T) * count, alignof(T)));
+}
+
+enum asset_state : uint32_t
+{
+    asset_state_unloaded,
+    asset_state_queued,
+    asset_state_loaded,
+};
+
+// Asset memory is carved out of a fixed budget as a list of blocks in address
+// order; each block's payload directly follows its header.
+struct asset_memory_block
+{
+    asset_memory_block *prev;
+    asset_memory_block *next;
+    uint64_t size;  // payload size
+    bool32 used;
+};
+
+struct asset_slot
+{
+    // set up by the game before the load is queued, then only read by the
+    // loader thread until the load completes
+    const hha_asset *info;
+    const uint8_t *source;
+    void *memory;
+
+    asset_state state;
+    asset_memory_block *block;
+    // loaded assets, most recently used first
+    asset_slot *lru_prev;
+    asset_slot *lru_next;
+    uint64_t last_use_frame;
+};
+
+struct asset_cache_stats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    // allocation failed because everything left was used this frame
+    uint64_t over_budget;
+    uint64_t bytes_used;
+};
+
+struct game_assets
+{
+    platform_file_view pack;
+    const hha_asset *infos;
+    uint32_t asset_count;
+    asset_slot *slots;
+
+    uint64_t frame_index;
+    uint64_t memory_budget;
+    asset_memory_block memory_sentinel;
+    asset_slot lru_sentinel;
+    asset_cache_stats stats;
+};
+
+struct transient_state
+{
+    bool32 is_initialized;
+    memory_arena arena;
+    game_assets assets;
+};
+
 struct game_state
 {
-    int32_t blue_offset;
-    int32_t green_offset;
+    // in pixels, as of the last update and the one before for interpolation
+    real32 blue_offset;
+    real32 green_offset;
+    real32 prev_blue_offset;
+    real32 prev_green_offset;
     real32 tone_hz;
+    real32 sine_t;
 };
@@ -0,0 +1,335 @@
+#include "handmade.h"
+#include "handmade_lz.h"
+
+constexpr const char *kAssetPackFile = "./data/handmade.hha";
+constexpr uint64_t kDefaultAssetMemoryBudget = megabyte(256);
+// block headers are padded so payloads keep the pack's data alignment
+constexpr uint64_t kAssetMemoryBlockHeaderSize =
+        (sizeof(asset_memory_block) + kHhaDataAlignment - 1) &
+        ~(kHhaDataAlignment - 1);
+// don't split off free blocks too small to ever hold anything
+constexpr uint64_t kAssetMemoryMinSplitSize = kilobyte(4);
+
+//
+// Asset memory
+//
+
+internal void *get_block_payload(asset_memory_block *block)
+{
+    return reinterpret_cast<uint8_t*>(block) + kAssetMemoryBlockHeaderSize;
+}
+
+internal void insert_block_after(asset_memory_block *prev, void *memory,
+                                 uint64_t size)
+{
+    HANDMADE_ASSERT(size > kAssetMemoryBlockHeaderSize);
+    asset_memory_block *block = static_cast<asset_memory_block*>(memory);
+    block->size = size - kAssetMemoryBlockHeaderSize;
+    block->used = false;
+    block->prev = prev;
+    block->next = prev->next;
+    block->prev->next = block;
+    block->next->prev = block;
+}
+
+internal void merge_with_next_block(game_assets *assets,
+                                    asset_memory_block *block)
+{
+    asset_memory_block *next = block->next;
+    if (next != &assets->memory_sentinel && !next->used &&
+        static_cast<uint8_t*>(get_block_payload(block)) + block->size ==
+        reinterpret_cast<uint8_t*>(next))
+    {
+        block->size += kAssetMemoryBlockHeaderSize + next->size;
+        block->next = next->next;
+        block->next->prev = block;
+    }
+}
+
+internal asset_memory_block *allocate_block(game_assets *assets, uint64_t size)
+{
+    // first fit
+    for (asset_memory_block *block = assets->memory_sentinel.next;
+         block != &assets->memory_sentinel;
+         block = block->next)
+    {
+        if (!block->used && block->size >= size)
+        {
+            uint64_t remaining = block->size - size;
+            if (remaining >= kAssetMemoryBlockHeaderSize +
+                kAssetMemoryMinSplitSize)
+            {
+                block->size = size;
+                insert_block_after(block,
+                                   static_cast<uint8_t*>(
+                                       get_block_payload(block)) + size,
+                                   remaining);
+            }
+            block->used = true;
+            assets->stats.bytes_used += block->size;
+            return block;
+        }
+    }
+    return nullptr;
+}
+
+internal void free_block(game_assets *assets, asset_memory_block *block)
+{
+    HANDMADE_ASSERT(block->used);
+    block->used = false;
+    assets->stats.bytes_used -= block->size;
+    merge_with_next_block(assets, block);
+    if (block->prev != &assets->memory_sentinel && !block->prev->used)
+    {
+        merge_with_next_block(assets, block->prev);
+    }
+}
+
+//
+// LRU list of loaded assets
+//
+
+internal void lru_remove(asset_slot *slot)
+{
+    slot->lru_prev->lru_next = slot->lru_next;
+    slot->lru_next->lru_prev = slot->lru_prev;
+    slot->lru_prev = slot->lru_next = nullptr;
+}
+
+internal void lru_push_front(game_assets *assets, asset_slot *slot)
+{
+    slot->lru_prev = &assets->lru_sentinel;
+    slot->lru_next = assets->lru_sentinel.lru_next;
+    slot->lru_prev->lru_next = slot;
+    slot->lru_next->lru_prev = slot;
+}
+
+internal void evict_asset(game_assets *assets, asset_slot *slot)
+{
+    HANDMADE_ASSERT(slot->state == asset_state_loaded);
+    lru_remove(slot);
+    free_block(assets, slot->block);
+    slot->block = nullptr;
+    slot->memory = nullptr;
+    slot->state = asset_state_unloaded;
+    ++assets->stats.evictions;
+}
+
+// evicts least recently used assets until the size fits; assets used this
+// frame are never evicted, returns null if only those are left
+internal asset_memory_block *acquire_asset_memory(game_assets *assets,
+                                                  uint64_t size)
+{
+    size = (size + kHhaDataAlignment - 1) & ~(kHhaDataAlignment - 1);
+    for (;;)
+    {
+        asset_memory_block *block = allocate_block(assets, size);
+        if (block)
+        {
+            return block;
+        }
+        asset_slot *lru = assets->lru_sentinel.lru_prev;
+        if (lru == &assets->lru_sentinel ||
+            lru->last_use_frame == assets->frame_index)
+        {
+            ++assets->stats.over_budget;
+            return nullptr;
+        }
+        evict_asset(assets, lru);
+    }
+}
+
+//
+// Assets
+//
+
+internal bool32 load_asset_pack(game_assets *assets, memory_arena *arena,
+                                const char *filename, uint64_t memory_budget)
+{
+    bool32 succeeded = false;
+    // only the header and index are touched here, payload pages are brought
+    // in by the loader thread
+    assets->pack = platform_map_file(filename, false);
+    if (!assets->pack.content)
+    {
+        return succeeded;
+    }
+
+    const uint8_t *pack = static_cast<const uint8_t*>(assets->pack.content);
+    uint64_t pack_size = assets->pack.size;
+    const hha_header *header = reinterpret_cast<const hha_header*>(pack);
+    bool32 valid = pack_size >= sizeof(hha_header) &&
+            header->magic == kHhaMagic &&
+            header->version == kHhaVersion &&
+            header->assets_offset % alignof(hha_asset) == 0 &&
+            header->assets_offset <= pack_size &&
+            header->asset_count <= (pack_size - header->assets_offset) /
+            sizeof(hha_asset);
+    const hha_asset *infos = nullptr;
+    if (valid)
+    {
+        infos = reinterpret_cast<const hha_asset*>(pack + header->assets_offset);
+        for (uint32_t asset_index = 0;
+             valid && asset_index < header->asset_count;
+             ++asset_index)
+        {
+            const hha_asset *info = &infos[asset_index];
+            valid = info->type < hha_asset_type_count &&
+                    info->compression < hha_compression_count &&
+                    info->data_offset <= pack_size &&
+                    info->data_size <= pack_size - info->data_offset &&
+                    (info->compression != hha_compression_none ||
+                     info->uncompressed_size == info->data_size);
+            if (valid && info->type == hha_asset_type_bitmap)
+            {
+                valid = info->uncompressed_size >=
+                        static_cast<uint64_t>(info->bitmap.width) *
+                        info->bitmap.height * 4;
+            }
+        }
+    }
+    if (!valid)
+    {
+        platform_unmap_file(&assets->pack);
+        return succeeded;
+    }
+
+    assets->infos = infos;
+    assets->asset_count = header->asset_count;
+    assets->slots = push_array<asset_slot>(arena, assets->asset_count);
+    for (uint32_t asset_index = 0;
+         asset_index < assets->asset_count;
+         ++asset_index)
+    {
+        asset_slot *slot = &assets->slots[asset_index];
+        slot->info = &infos[asset_index];
+        slot->source = pack + slot->info->data_offset;
+        slot->state = asset_state_unloaded;
+    }
+
+    // the budget is a fixed slice of the arena, it never grows
+    uint64_t arena_left = arena->size - arena->used;
+    arena_left = arena_left > kHhaDataAlignment ?
+            arena_left - kHhaDataAlignment : 0;
+    assets->memory_budget = std::min(
+        memory_budget ? memory_budget : kDefaultAssetMemoryBudget, arena_left);
+    if (assets->memory_budget <= kAssetMemoryBlockHeaderSize)
+    {
+        platform_unmap_file(&assets->pack);
+        *assets = {};
+        return succeeded;
+    }
+    assets->memory_sentinel.next = &assets->memory_sentinel;
+    assets->memory_sentinel.prev = &assets->memory_sentinel;
+    assets->memory_sentinel.used = true;
+    insert_block_after(&assets->memory_sentinel,
+                       push_size(arena, assets->memory_budget,
+                                 kHhaDataAlignment),
+                       assets->memory_budget);
+    assets->lru_sentinel.lru_next = &assets->lru_sentinel;
+    assets->lru_sentinel.lru_prev = &assets->lru_sentinel;
+    succeeded = true;
+    return succeeded;
+}
+
+// runs on the loader thread
+internal PLATFORM_LOAD_PROC(load_asset_work)
+{
+    TIMED_BLOCK("load_asset");
+    asset_slot *slot = static_cast<asset_slot*>(data);
+    uint8_t *memory = static_cast<uint8_t*>(slot->memory);
+    size_t data_size = static_cast<size_t>(slot->info->data_size);
+    size_t uncompressed_size =
+            static_cast<size_t>(slot->info->uncompressed_size);
+    switch (slot->info->compression)
+    {
+    case hha_compression_lz:
+        {
+            // decompress straight from the mapped pack into the cache
+            if (!lz_decompress(slot->source, data_size, memory,
+                               uncompressed_size))
+            {
+                // corrupt pack, better blank than half decoded
+                HANDMADE_ASSERT(false);
+                std::memset(memory, 0, uncompressed_size);
+            }
+        }
+        break;
+    case hha_compression_none:
+    case hha_compression_count:
+        {
+            std::memcpy(memory, slot->source, data_size);
+        }
+        break;
+    }
+}
+
+internal void request_asset(game_assets *assets, uint32_t asset_index)
+{
+    HANDMADE_ASSERT(asset_index < assets->asset_count);
+    asset_slot *slot = &assets->slots[asset_index];
+    if (slot->state != asset_state_unloaded)
+    {
+        return;
+    }
+    slot->block = acquire_asset_memory(assets, slot->info->uncompressed_size);
+    if (!slot->block)
+    {
+        return;
+    }
+    slot->memory = get_block_payload(slot->block);
+    slot->state = asset_state_queued;
+    if (!platform_push_load(load_asset_work, slot))
+    {
+        // queue full, try again on the next request
+        free_block(assets, slot->block);
+        slot->block = nullptr;
+        slot->memory = nullptr;
+        slot->state = asset_state_unloaded;
+    }
+}
+
+// call once at the start of every frame
+internal void begin_asset_frame(game_assets *assets)
+{
+    TIMED_BLOCK("begin_asset_frame");
+    ++assets->frame_index;
+    void *data = nullptr;
+    while (platform_pop_completed_load(&data))
+    {
+        asset_slot *slot = static_cast<asset_slot*>(data);
+        HANDMADE_ASSERT(slot >= assets->slots &&
+                        slot < assets->slots + assets->asset_count);
+        HANDMADE_ASSERT(slot->state == asset_state_queued);
+        slot->state = asset_state_loaded;
+        slot->last_use_frame = assets->frame_index;
+        lru_push_front(assets, slot);
+    }
+}
+
+// marks the asset as used this frame; returns null and requests it if it
+// isn't loaded yet
+internal const asset_slot *get_asset(game_assets *assets, uint32_t asset_index,
+                                     hha_asset_type type)
+{
+    const asset_slot *result = nullptr;
+    if (asset_index < assets->asset_count &&
+        assets->infos[asset_index].type == type)
+    {
+        asset_slot *slot = &assets->slots[asset_index];
+        if (slot->state == asset_state_loaded)
+        {
+            ++assets->stats.hits;
+            slot->last_use_frame = assets->frame_index;
+            lru_remove(slot);
+            lru_push_front(assets, slot);
+            result = slot;
+        }
+        else
+        {
+            ++assets->stats.misses;
+            request_asset(assets, asset_index);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+//
+// Asset pack (.hha) file format.
+//
+// The file is meant to be mapped and used in place, so everything is plain
+// little endian POD with fixed size fields, and every offset is from the
+// start of the file:
+//
+//   hha_header
+//   hha_asset[asset_count]     at header.assets_offset
+//   payloads                   each at hha_asset::data_offset, aligned to
+//                              kHhaDataAlignment, raw or LZ compressed
+//                              (handmade_lz.h)
+//
+// Shared by the game and the asset_packer tool, so no game types in here.
+//
+
+#include <cstdint>
+
+constexpr uint32_t kHhaMagic = 0x66616868;  // "hhaf"
+constexpr uint32_t kHhaVersion = 2;
+constexpr uint64_t kHhaDataAlignment = 64;
+
+enum hha_asset_type : uint32_t
+{
+    hha_asset_type_bitmap,
+    hha_asset_type_sound,
+    hha_asset_type_font,
+
+    hha_asset_type_count
+};
+
+enum hha_compression : uint32_t
+{
+    hha_compression_none,
+    hha_compression_lz,
+
+    hha_compression_count
+};
+
+struct hha_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t asset_count;
+    uint32_t reserved;
+    uint64_t assets_offset;
+};
+
+// pixels are 32-bit, memory order BB GG RR AA, top-down, pitch = width * 4
+struct hha_bitmap
+{
+    uint32_t width;
+    uint32_t height;
+};
+
+// interleaved int16_t samples
+struct hha_sound
+{
+    uint32_t sample_count;
+    uint32_t channel_count;
+    uint32_t samples_per_sec;
+};
+
+// monospace glyph atlas, glyphs laid out left to right in one row starting
+// at first_codepoint; pixels as in hha_bitmap
+struct hha_font
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t first_codepoint;
+    uint32_t glyph_count;
+};
+
+struct hha_asset
+{
+    uint64_t data_offset;
+    uint64_t data_size;  // as stored in the pack
+    uint64_t uncompressed_size;
+    hha_asset_type type;
+    hha_compression compression;
+    union
+    {
+        hha_bitmap bitmap;
+        hha_sound sound;
+        hha_font font;
+        uint32_t pad[4];
+    };
+};
+
+static_assert(sizeof(hha_header) == 24, "hha_header layout changed");
+static_assert(sizeof(hha_asset) == 48, "hha_asset layout changed");
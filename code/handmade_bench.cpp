@@ -0,0 +1,520 @@
+/*
+  Microbenchmarks for game layer kernels, built on handmade.cpp with stub
+  platform services and no SDL.
+
+  Usage: handmade_bench [--filter <substring>] [--seconds <s>] [--profile]
+
+  Every case is warmed up, then timed with the calibrated TSC rep after rep
+  for at least --seconds (default 0.2), and the per rep times go into a
+  histogram. Results are CSV on stdout, one row per kernel and size; the
+  machine and timer go to stderr, so stdout can be diffed between builds.
+  In diagnostic builds --profile prints the TIMED_BLOCK tree of the last rep
+  after every row, which is for reading, not tracking.
+
+  To add a kernel, write a bench_proc running one rep of it at a given size
+  and add it to kBenchCases.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "handmade.h"
+#include "handmade.cpp"
+#include "handmade_histogram.h"
+
+constexpr double kWarmupSeconds = 0.05;
+constexpr double kDefaultBenchSeconds = 0.2;
+constexpr uint32_t kMinBenchReps = 10;
+constexpr uint32_t kMaxBenchReps = 1000000;
+
+//
+// Platform services the game calls, done the simplest way that works here.
+//
+
+struct platform_work_queue
+{
+    uint64_t jobs_executed;
+};
+
+internal platform_file_view platform_map_file(const char *, bool32)
+{
+    return platform_file_view {};
+}
+
+internal void platform_unmap_file(platform_file_view *view)
+{
+    *view = {};
+}
+
+// nothing is ever loaded in a bench, but complete it in case
+global_variable void *g_completed_load = nullptr;
+
+internal bool32 platform_push_load(platform_load_proc *proc, void *data)
+{
+    bool32 result = false;
+    if (!g_completed_load)
+    {
+        proc(data);
+        g_completed_load = data;
+        result = true;
+    }
+    return result;
+}
+
+internal bool32 platform_pop_completed_load(void **data)
+{
+    bool32 result = g_completed_load != nullptr;
+    *data = g_completed_load;
+    g_completed_load = nullptr;
+    return result;
+}
+
+// single threaded on purpose, a kernel is measured on one core
+internal void platform_add_entry(platform_work_queue *queue,
+                                 platform_work_queue_callback *callback,
+                                 void *data)
+{
+    callback(queue, data);
+    ++queue->jobs_executed;
+}
+
+internal void platform_complete_all_work(platform_work_queue *)
+{
+}
+
+internal platform_work_queue_stats platform_get_work_queue_stats(
+    platform_work_queue *queue)
+{
+    platform_work_queue_stats result {};
+    result.jobs_executed = queue->jobs_executed;
+    return result;
+}
+
+internal uint64_t platform_read_os_clock_ns()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#if HANDMADE_INTERNAL_BUILD
+internal bool32 debug_platform_write_entire_file(const char *, void *,
+                                                 uint32_t)
+{
+    return false;
+}
+#endif  // HANDMADE_INTERNAL_BUILD
+
+//
+// Kernels.
+//
+
+// results that would otherwise be dead go here, so they're still computed
+global_variable volatile real32 g_bench_sink;
+
+// buffers big enough for the largest size of every case
+struct bench_state
+{
+    void *pixels;
+    game_offscreen_buffer buffer;
+    int16_t *samples;
+    real32 *stick_values;
+    game_controller_input *controllers;
+    game_packed_input *packed_inputs;
+    game_input *inputs;
+    platform_work_queue queue;
+    game_memory memory;
+    game_input input;
+};
+
+// runs one rep; size is what the case sweeps, returns items processed
+#define BENCH_PROC(name) uint64_t name(bench_state *state, uint32_t size)
+typedef BENCH_PROC(bench_proc);
+
+constexpr uint32_t kMaxBenchWidth = 3840;
+constexpr uint32_t kMaxBenchHeight = 2160;
+constexpr uint32_t kMaxBenchSamples = 48000;
+constexpr uint32_t kMaxBenchStickValues = 65536;
+constexpr uint32_t kMaxBenchControllers = 4096;
+constexpr uint32_t kMaxBenchInputFrames = 4096;
+constexpr uint64_t kBenchPermanentStorageSize = megabyte(1);
+constexpr uint64_t kBenchTransientStorageSize = megabyte(16);
+
+internal void bench_set_buffer_size(bench_state *state, uint32_t width)
+{
+    // 16:9 like the backbuffer
+    state->buffer.width = static_cast<int32_t>(width);
+    state->buffer.height = static_cast<int32_t>(width * 9 / 16);
+    state->buffer.pitch = state->buffer.width * 4;
+    state->buffer.memory = state->pixels;
+}
+
+internal BENCH_PROC(bench_render_weird_gradient)
+{
+    bench_set_buffer_size(state, size);
+    render_weird_gradient(&state->buffer, 7, 13, 0, state->buffer.height);
+    return static_cast<uint64_t>(state->buffer.width) *
+            static_cast<uint64_t>(state->buffer.height);
+}
+
+// the way game_update_and_render issues it, in bands through the queue
+internal BENCH_PROC(bench_render_gradient_bands)
+{
+    bench_set_buffer_size(state, size);
+    render_gradient_work work[kRenderBandCount];
+    int32_t band_height = (state->buffer.height + kRenderBandCount - 1) /
+            kRenderBandCount;
+    for (int32_t band_index = 0; band_index < kRenderBandCount; ++band_index)
+    {
+        work[band_index].buffer = &state->buffer;
+        work[band_index].blue_offset = 7;
+        work[band_index].green_offset = 13;
+        work[band_index].min_y = std::min(band_index * band_height,
+                                          state->buffer.height);
+        work[band_index].max_y = std::min(work[band_index].min_y + band_height,
+                                          state->buffer.height);
+        platform_add_entry(&state->queue, do_render_gradient_work,
+                           &work[band_index]);
+    }
+    platform_complete_all_work(&state->queue);
+    return static_cast<uint64_t>(state->buffer.width) *
+            static_cast<uint64_t>(state->buffer.height);
+}
+
+// a whole frame at 60Hz with no asset pack and no input
+internal BENCH_PROC(bench_game_update_and_render)
+{
+    bench_set_buffer_size(state, size);
+    game_sound_buffer sound_buffer {};
+    sound_buffer.samples_per_sec = 48000;
+    sound_buffer.sample_count = sound_buffer.samples_per_sec / 60;
+    sound_buffer.samples = state->samples;
+    state->input.dt_for_frame = 1.0f / 60.0f;
+    game_update_and_render(&state->memory, &state->buffer, &sound_buffer,
+                           &state->input);
+    return static_cast<uint64_t>(state->buffer.width) *
+            static_cast<uint64_t>(state->buffer.height);
+}
+
+internal BENCH_PROC(bench_draw_bitmap)
+{
+    bench_set_buffer_size(state, kMaxBenchWidth);
+    // a square bitmap of the given side, sourced from the top of the pixels
+    // so it never overlaps where it's drawn
+    hha_asset info {};
+    info.type = hha_asset_type_bitmap;
+    info.bitmap.width = size;
+    info.bitmap.height = size;
+    asset_slot bitmap {};
+    bitmap.info = &info;
+    bitmap.memory = state->pixels;
+    draw_bitmap(&state->buffer, &bitmap, 0, static_cast<int32_t>(size));
+    return static_cast<uint64_t>(size) * size;
+}
+
+internal BENCH_PROC(bench_game_output_sound)
+{
+    game_sound_buffer sound_buffer {};
+    sound_buffer.samples_per_sec = 48000;
+    sound_buffer.sample_count = size;
+    sound_buffer.samples = state->samples;
+    local_persist real32 sine_t = 0.0f;
+    game_output_sound(&sound_buffer, 256.0f, &sine_t);
+    return size;
+}
+
+internal BENCH_PROC(bench_resolve_stick_deadzone)
+{
+    real32 *values = state->stick_values;
+    real32 sum = 0.0f;
+    for (uint32_t value_index = 0; value_index < size; ++value_index)
+    {
+        sum += resolve_stick_deadzone(values[value_index], 32767.0f, 0.17f);
+    }
+    g_bench_sink = sum;
+    return size;
+}
+
+internal BENCH_PROC(bench_process_digital_buttons)
+{
+    game_controller_input *controllers = state->controllers;
+    for (uint32_t controller_index = 1;
+         controller_index < size;
+         ++controller_index)
+    {
+        game_controller_input *new_controller = &controllers[controller_index];
+        const game_controller_input *old_controller =
+                &controllers[controller_index - 1];
+        for (uint32_t button_index = 0;
+             button_index < array_length(new_controller->buttons);
+             ++button_index)
+        {
+            process_digital_button(
+                &new_controller->buttons[button_index],
+                &old_controller->buttons[button_index],
+                static_cast<bool32>((controller_index + button_index) & 1));
+        }
+    }
+    return static_cast<uint64_t>(size - 1) *
+            array_length(controllers[0].buttons);
+}
+
+// the way the SDL layer does it, a mask per controller for a whole frame
+internal BENCH_PROC(bench_process_button_masks)
+{
+    for (uint32_t frame_index = 1; frame_index < size; ++frame_index)
+    {
+        uint16_t down_masks[game_input::max_controller_count];
+        for (int32_t controller_index = 0;
+             controller_index < game_input::max_controller_count;
+             ++controller_index)
+        {
+            down_masks[controller_index] = state->packed_inputs[frame_index]
+                    .controllers[controller_index].ended_down_mask;
+        }
+        process_button_masks(&state->inputs[frame_index],
+                             &state->inputs[frame_index - 1], down_masks, 0);
+    }
+    return static_cast<uint64_t>(size - 1) * game_input::max_controller_count;
+}
+
+// replaying a recording of size frames
+internal BENCH_PROC(bench_unpack_input)
+{
+    for (uint32_t frame_index = 1; frame_index < size; ++frame_index)
+    {
+        unpack_input(&state->inputs[frame_index],
+                     &state->packed_inputs[frame_index],
+                     &state->packed_inputs[frame_index - 1]);
+    }
+    return static_cast<uint64_t>(size - 1) * game_input::max_controller_count;
+}
+
+struct bench_case
+{
+    const char *name;
+    bench_proc *proc;
+    uint32_t sizes[5];
+};
+
+global_variable const bench_case kBenchCases[] = {
+    {"game_update_and_render", bench_game_update_and_render,
+     {320, 640, 1280, 1920, 3840}},
+    {"render_weird_gradient", bench_render_weird_gradient,
+     {320, 640, 1280, 1920, 3840}},
+    {"render_gradient_bands", bench_render_gradient_bands,
+     {320, 640, 1280, 1920, 3840}},
+    {"draw_bitmap", bench_draw_bitmap, {16, 64, 256, 512, 1024}},
+    {"game_output_sound", bench_game_output_sound,
+     {256, 800, 1600, 4096, 48000}},
+    {"resolve_stick_deadzone", bench_resolve_stick_deadzone,
+     {4, 64, 1024, 16384, 65536}},
+    {"process_digital_button", bench_process_digital_buttons,
+     {2, 16, 256, 1024, 4096}},
+    {"process_button_masks", bench_process_button_masks,
+     {2, 16, 256, 1024, 4096}},
+    {"unpack_input", bench_unpack_input, {2, 16, 256, 1024, 4096}},
+};
+
+//
+// Driver.
+//
+
+struct bench_result
+{
+    uint64_t items;
+    uint64_t total_ticks;
+    histogram ticks;
+};
+
+internal uint64_t bench_ticks_for(const timer_info *timer, double seconds)
+{
+    return static_cast<uint64_t>(
+        seconds * static_cast<double>(timer->ticks_per_sec));
+}
+
+internal void run_bench(const timer_info *timer, bench_state *state,
+                        bench_proc *proc, uint32_t size, double seconds,
+                        bench_result *result)
+{
+    // caches, branch predictors and clocks settle first
+    uint64_t warmup_end = read_timer(timer) +
+            bench_ticks_for(timer, kWarmupSeconds);
+    do
+    {
+        proc(state, size);
+    } while (read_timer(timer) < warmup_end);
+
+    histogram_reset(&result->ticks);
+    result->total_ticks = 0;
+    uint64_t min_ticks = bench_ticks_for(timer, seconds);
+    uint32_t reps = 0;
+    while (reps < kMinBenchReps ||
+           (result->total_ticks < min_ticks && reps < kMaxBenchReps))
+    {
+        uint64_t start = read_timer(timer);
+        result->items = proc(state, size);
+        uint64_t ticks = read_timer(timer) - start;
+        histogram_record(&result->ticks, ticks);
+        result->total_ticks += ticks;
+        ++reps;
+#if HANDMADE_DIAGNOSTIC
+        // keeps the rings drained, as a frame would
+        profiler_end_frame();
+#endif  // HANDMADE_DIAGNOSTIC
+    }
+}
+
+internal double bench_ns(const timer_info *timer, uint64_t ticks)
+{
+    return static_cast<double>(ticks_to_ns(timer, ticks));
+}
+
+internal void print_bench_result(const timer_info *timer, const char *name,
+                                 uint32_t size, const bench_result *result)
+{
+    const histogram *ticks = &result->ticks;
+    uint64_t p50 = histogram_percentile(ticks, 0.5);
+    double mean_ns = bench_ns(timer, result->total_ticks) /
+            static_cast<double>(ticks->count);
+    printf("%s,%u,%" PRIu64 ",%" PRIu64 ",%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,"
+           "%.4f,%" PRIu64 "\n",
+           name, size, result->items, ticks->count,
+           bench_ns(timer, ticks->min), bench_ns(timer, p50),
+           bench_ns(timer, histogram_percentile(ticks, 0.9)),
+           bench_ns(timer, histogram_percentile(ticks, 0.99)),
+           bench_ns(timer, ticks->max), mean_ns,
+           bench_ns(timer, p50) / static_cast<double>(result->items),
+           timer->uses_tsc ? p50 : 0);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = nullptr;
+    double seconds = kDefaultBenchSeconds;
+    bool32 profile = false;
+    for (int arg_index = 1; arg_index < argc; ++arg_index)
+    {
+        bool32 has_value = arg_index + 1 < argc;
+        if (strcmp(argv[arg_index], "--filter") == 0 && has_value)
+        {
+            filter = argv[++arg_index];
+        }
+        else if (strcmp(argv[arg_index], "--seconds") == 0 && has_value)
+        {
+            seconds = atof(argv[++arg_index]);
+        }
+        else if (strcmp(argv[arg_index], "--profile") == 0)
+        {
+            profile = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--filter <substring>] "
+                    "[--seconds <s>] [--profile]\n", argv[0]);
+            return 1;
+        }
+    }
+
+#if HANDMADE_DIAGNOSTIC
+    profiler_name_thread("bench");
+#endif  // HANDMADE_DIAGNOSTIC
+    cpu_info cpu {};
+    query_cpu_info(&cpu);
+    timer_info timer {};
+    calibrate_timer(&timer, &cpu);
+    fprintf(stderr, "cpu: %s\ntimer: %s at %" PRIu64 " ticks/s\n", cpu.brand,
+            timer.uses_tsc ? "tsc" : "os clock", timer.ticks_per_sec);
+
+    bench_state state {};
+    state.pixels = calloc(kMaxBenchWidth * kMaxBenchHeight, 4);
+    state.samples = static_cast<int16_t*>(
+        calloc(kMaxBenchSamples * 2, sizeof(int16_t)));
+    state.stick_values = static_cast<real32*>(
+        malloc(kMaxBenchStickValues * sizeof(real32)));
+    state.controllers = static_cast<game_controller_input*>(
+        calloc(kMaxBenchControllers, sizeof(game_controller_input)));
+    state.packed_inputs = static_cast<game_packed_input*>(
+        calloc(kMaxBenchInputFrames, sizeof(game_packed_input)));
+    state.inputs = static_cast<game_input*>(
+        calloc(kMaxBenchInputFrames, sizeof(game_input)));
+    state.memory.permanent_storage_size = kBenchPermanentStorageSize;
+    state.memory.permanent_storage = calloc(kBenchPermanentStorageSize, 1);
+    state.memory.transient_storage_size = kBenchTransientStorageSize;
+    state.memory.transient_storage = calloc(kBenchTransientStorageSize, 1);
+    state.memory.work_queue = &state.queue;
+    state.memory.cpu = cpu;
+    state.memory.timer = timer;
+    // the whole axis range, in an order the branch predictor can't learn
+    uint32_t seed = 1;
+    for (uint32_t value_index = 0;
+         value_index < kMaxBenchStickValues;
+         ++value_index)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        state.stick_values[value_index] =
+                static_cast<real32>(static_cast<int32_t>(seed >> 16) - 32768);
+    }
+    // a few buttons changing every frame
+    for (uint32_t frame_index = 0;
+         frame_index < kMaxBenchInputFrames;
+         ++frame_index)
+    {
+        for (int32_t controller_index = 0;
+             controller_index < game_input::max_controller_count;
+             ++controller_index)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            state.packed_inputs[frame_index].controllers[controller_index]
+                    .ended_down_mask = static_cast<uint16_t>(
+                        (seed >> 16) & (seed >> 8) & 0xfff);
+        }
+    }
+
+    // one histogram is too big for the stack
+    bench_result *result =
+            static_cast<bench_result*>(malloc(sizeof(bench_result)));
+    printf("kernel,size,items,reps,min_ns,p50_ns,p90_ns,p99_ns,max_ns,"
+           "mean_ns,p50_ns_per_item,p50_cycles\n");
+    for (uint32_t case_index = 0;
+         case_index < array_length(kBenchCases);
+         ++case_index)
+    {
+        const bench_case *bench = &kBenchCases[case_index];
+        if (filter && !strstr(bench->name, filter))
+        {
+            continue;
+        }
+        for (uint32_t size_index = 0;
+             size_index < array_length(bench->sizes);
+             ++size_index)
+        {
+            uint32_t size = bench->sizes[size_index];
+            run_bench(&timer, &state, bench->proc, size, seconds, result);
+            print_bench_result(&timer, bench->name, size, result);
+#if HANDMADE_DIAGNOSTIC
+            if (profile)
+            {
+                profiler_print_frame(profiler_get_last_frame(), &timer);
+            }
+#else  // HANDMADE_DIAGNOSTIC
+            (void)profile;
+#endif  // HANDMADE_DIAGNOSTIC
+        }
+    }
+
+    fprintf(stderr, "work queue: %" PRIu64 " jobs\n",
+            platform_get_work_queue_stats(&state.queue).jobs_executed);
+    free(result);
+    free(state.memory.transient_storage);
+    free(state.memory.permanent_storage);
+    free(state.inputs);
+    free(state.packed_inputs);
+    free(state.controllers);
+    free(state.stick_values);
+    free(state.samples);
+    free(state.pixels);
+    return 0;
+}
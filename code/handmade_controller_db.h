@@ -0,0 +1,105 @@
+#pragma once
+
+//
+// Controller mapping database (.hcdb) file format.
+//
+// SDL's gamecontrollerdb.txt compiled by controller_db_packer for one
+// platform, so a pad's mapping is found by its joystick GUID when it's
+// plugged in instead of the whole text file being parsed at startup. The
+// file is meant to be mapped and used in place, so everything is plain
+// little endian POD, and every offset is from the start of the file:
+//
+//   hcdb_header
+//   uint32_t[bucket_count]     at header.buckets_offset, open addressed hash
+//                              table of entry index + 1, 0 when empty
+//   hcdb_entry[entry_count]    at header.entries_offset
+//   mappings                   SDL mapping lines, 0 terminated, each at
+//                              hcdb_entry::mapping_offset
+//
+// Shared by the platform layer and the packer tool, so no game types in here.
+//
+
+#include <cstdint>
+#include <cstring>
+
+constexpr uint32_t kHcdbMagic = 0x62646368;  // "hcdb"
+constexpr uint32_t kHcdbVersion = 1;
+constexpr uint32_t kHcdbGuidSize = 16;
+constexpr uint32_t kHcdbPlatformSize = 16;
+
+struct hcdb_header
+{
+    uint32_t magic;
+    uint32_t version;
+    // as SDL_GetPlatform names it, 0 terminated
+    char platform[kHcdbPlatformSize];
+    uint32_t entry_count;
+    // a power of 2, at least twice entry_count
+    uint32_t bucket_count;
+    uint32_t buckets_offset;
+    uint32_t entries_offset;
+};
+
+struct hcdb_entry
+{
+    uint8_t guid[kHcdbGuidSize];
+    uint32_t mapping_offset;
+    uint32_t mapping_size;  // without the 0
+};
+
+static_assert(sizeof(hcdb_header) == 40, "hcdb_header layout changed");
+static_assert(sizeof(hcdb_entry) == 24, "hcdb_entry layout changed");
+
+// FNV-1a
+inline uint32_t hcdb_hash_guid(const uint8_t *guid)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t byte_index = 0; byte_index < kHcdbGuidSize; ++byte_index)
+    {
+        hash = (hash ^ guid[byte_index]) * 16777619u;
+    }
+    return hash;
+}
+
+// header checks only, the tables are trusted to be as the packer wrote them
+inline bool hcdb_is_valid(const void *file, uint64_t size)
+{
+    if (size < sizeof(hcdb_header))
+    {
+        return false;
+    }
+    const hcdb_header *header = static_cast<const hcdb_header*>(file);
+    uint64_t bucket_count = header->bucket_count;
+    return header->magic == kHcdbMagic && header->version == kHcdbVersion &&
+            bucket_count && (bucket_count & (bucket_count - 1)) == 0 &&
+            bucket_count > header->entry_count &&
+            header->buckets_offset + bucket_count * sizeof(uint32_t) <= size &&
+            header->entries_offset +
+            static_cast<uint64_t>(header->entry_count) * sizeof(hcdb_entry) <=
+            size &&
+            header->platform[kHcdbPlatformSize - 1] == 0;
+}
+
+// the mapping line for a GUID, null if there's none
+inline const char *hcdb_find_mapping(const void *file, const uint8_t *guid)
+{
+    const uint8_t *base = static_cast<const uint8_t*>(file);
+    const hcdb_header *header = static_cast<const hcdb_header*>(file);
+    const uint32_t *buckets =
+            reinterpret_cast<const uint32_t*>(base + header->buckets_offset);
+    const hcdb_entry *entries =
+            reinterpret_cast<const hcdb_entry*>(base + header->entries_offset);
+    uint32_t mask = header->bucket_count - 1;
+    // never full, so an empty bucket ends every probe
+    for (uint32_t bucket = hcdb_hash_guid(guid) & mask;
+         buckets[bucket];
+         bucket = (bucket + 1) & mask)
+    {
+        const hcdb_entry *entry = &entries[buckets[bucket] - 1];
+        if (std::memcmp(entry->guid, guid, kHcdbGuidSize) == 0)
+        {
+            return reinterpret_cast<const char*>(base + entry->mapping_offset);
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+//
+// CPU feature detection through CPUID, queried once by the platform layer at
+// startup and handed to the game in game_memory.
+//
+// Vector extensions only count as present when the os also saves their
+// registers (XGETBV), so anything flagged here is safe to execute. On non x86
+// targets everything reads as unsupported.
+//
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#  define HANDMADE_X86 1
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <cpuid.h>
+#  define HANDMADE_X86 1
+#else
+#  define HANDMADE_X86 0
+#endif
+
+struct cpu_info
+{
+    char vendor[13];
+    char brand[49];
+
+    bool32 has_sse2;
+    bool32 has_sse3;
+    bool32 has_ssse3;
+    bool32 has_sse41;
+    bool32 has_sse42;
+    bool32 has_popcnt;
+    bool32 has_avx;
+    bool32 has_avx2;
+    bool32 has_fma;
+    bool32 has_bmi2;
+    bool32 has_avx512f;
+    bool32 has_avx512bw;
+    bool32 has_avx512vl;
+
+    bool32 has_rdtscp;
+    // ticks at a constant rate through frequency and power state changes
+    bool32 has_invariant_tsc;
+
+    // in bytes, 0 when the cpu doesn't say
+    uint32_t cache_line_size;
+    uint32_t l1d_cache_size;
+    uint32_t l2_cache_size;
+    uint32_t l3_cache_size;
+};
+
+inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4])
+{
+#if defined(_MSC_VER)
+    int result[4];
+    __cpuidex(result, static_cast<int>(leaf), static_cast<int>(subleaf));
+    std::memcpy(regs, result, sizeof(result));
+#elif HANDMADE_X86
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+    (void)leaf;
+    (void)subleaf;
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+}
+
+inline uint64_t read_tsc()
+{
+#if defined(_MSC_VER)
+    return __rdtsc();
+#elif HANDMADE_X86
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// waits for earlier instructions to finish before reading, and returns the
+// IA32_TSC_AUX value (the cpu number on linux) in aux; check has_rdtscp
+inline uint64_t read_tscp(uint32_t *aux)
+{
+#if defined(_MSC_VER)
+    unsigned int result_aux = 0;
+    uint64_t result = __rdtscp(&result_aux);
+    *aux = result_aux;
+    return result;
+#elif HANDMADE_X86
+    unsigned int result_aux = 0;
+    uint64_t result = __builtin_ia32_rdtscp(&result_aux);
+    *aux = result_aux;
+    return result;
+#else
+    *aux = 0;
+    return 0;
+#endif
+}
+
+// which register state the os saves on context switches
+inline uint64_t read_xcr0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#elif HANDMADE_X86
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+inline bool32 cpuid_bit(uint32_t reg, uint32_t bit)
+{
+    return static_cast<bool32>((reg >> bit) & 1);
+}
+
+// walks a deterministic cache parameters leaf (4 on intel, 0x8000001d on amd)
+inline void query_cpu_caches(cpu_info *info, uint32_t leaf)
+{
+    uint32_t regs[4];
+    for (uint32_t subleaf = 0; subleaf < 16; ++subleaf)
+    {
+        cpuid(leaf, subleaf, regs);
+        uint32_t type = regs[0] & 0x1f;
+        if (type == 0)
+        {
+            break;
+        }
+        uint32_t level = (regs[0] >> 5) & 0x7;
+        uint32_t ways = (regs[1] >> 22) + 1;
+        uint32_t partitions = ((regs[1] >> 12) & 0x3ff) + 1;
+        uint32_t line_size = (regs[1] & 0xfff) + 1;
+        uint32_t sets = regs[2] + 1;
+        uint32_t size = ways * partitions * line_size * sets;
+        // 1 is data, 3 unified; instruction caches don't matter here
+        if (level == 1 && type == 1)
+        {
+            info->l1d_cache_size = size;
+            info->cache_line_size = line_size;
+        }
+        else if (level == 2 && type == 3)
+        {
+            info->l2_cache_size = size;
+        }
+        else if (level == 3 && type == 3)
+        {
+            info->l3_cache_size = size;
+        }
+    }
+}
+
+inline void query_cpu_info(cpu_info *info)
+{
+    *info = {};
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+    // vendor string is ebx, edx, ecx
+    std::memcpy(info->vendor + 0, &regs[1], 4);
+    std::memcpy(info->vendor + 4, &regs[3], 4);
+    std::memcpy(info->vendor + 8, &regs[2], 4);
+    cpuid(0x80000000, 0, regs);
+    uint32_t max_extended_leaf = regs[0];
+
+    uint32_t leaf_1_ecx = 0;
+    if (max_leaf >= 1)
+    {
+        cpuid(1, 0, regs);
+        leaf_1_ecx = regs[2];
+        info->has_sse2 = cpuid_bit(regs[3], 26);
+        info->has_sse3 = cpuid_bit(leaf_1_ecx, 0);
+        info->has_ssse3 = cpuid_bit(leaf_1_ecx, 9);
+        info->has_sse41 = cpuid_bit(leaf_1_ecx, 19);
+        info->has_sse42 = cpuid_bit(leaf_1_ecx, 20);
+        info->has_popcnt = cpuid_bit(leaf_1_ecx, 23);
+        // clflush line size, overridden by the cache leaves below
+        info->cache_line_size = ((regs[1] >> 8) & 0xff) * 8;
+    }
+
+    // xmm and ymm state for avx, plus opmask and zmm state for avx-512
+    uint64_t xcr0 = cpuid_bit(leaf_1_ecx, 27) ? read_xcr0() : 0;
+    bool32 os_avx = (xcr0 & 0x6) == 0x6;
+    bool32 os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+    info->has_avx = os_avx && cpuid_bit(leaf_1_ecx, 28);
+    info->has_fma = info->has_avx && cpuid_bit(leaf_1_ecx, 12);
+    if (max_leaf >= 7)
+    {
+        cpuid(7, 0, regs);
+        info->has_avx2 = os_avx && cpuid_bit(regs[1], 5);
+        info->has_bmi2 = cpuid_bit(regs[1], 8);
+        info->has_avx512f = os_avx512 && cpuid_bit(regs[1], 16);
+        info->has_avx512bw = os_avx512 && cpuid_bit(regs[1], 30);
+        info->has_avx512vl = os_avx512 && cpuid_bit(regs[1], 31);
+    }
+
+    bool32 has_amd_cache_leaf = false;
+    if (max_extended_leaf >= 0x80000001)
+    {
+        cpuid(0x80000001, 0, regs);
+        info->has_rdtscp = cpuid_bit(regs[3], 27);
+        has_amd_cache_leaf = cpuid_bit(regs[2], 22);
+    }
+    if (max_extended_leaf >= 0x80000004)
+    {
+        for (uint32_t leaf_index = 0; leaf_index < 3; ++leaf_index)
+        {
+            cpuid(0x80000002 + leaf_index, 0, regs);
+            std::memcpy(info->brand + leaf_index * 16, regs, 16);
+        }
+    }
+    if (max_extended_leaf >= 0x80000007)
+    {
+        cpuid(0x80000007, 0, regs);
+        info->has_invariant_tsc = cpuid_bit(regs[3], 8);
+    }
+
+    if (has_amd_cache_leaf && max_extended_leaf >= 0x8000001d)
+    {
+        query_cpu_caches(info, 0x8000001d);
+    }
+    else if (max_leaf >= 4)
+    {
+        query_cpu_caches(info, 4);
+    }
+    else if (max_extended_leaf >= 0x80000006)
+    {
+        // older amd, sizes in KB
+        cpuid(0x80000005, 0, regs);
+        info->l1d_cache_size = (regs[2] >> 24) * 1024;
+        info->cache_line_size = regs[2] & 0xff;
+        cpuid(0x80000006, 0, regs);
+        info->l2_cache_size = (regs[2] >> 16) * 1024;
+        // in 512KB units
+        info->l3_cache_size = (regs[3] >> 18) * 512 * 1024;
+    }
+}
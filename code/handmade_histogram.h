@@ -0,0 +1,124 @@
+#pragma once
+
+//
+// Fixed-bucket, HDR style histogram for latencies (frame times and the like).
+//
+// Values below 2^kHistogramSubBucketBits are counted exactly. Above that,
+// every power of two range is split into 2^(kHistogramSubBucketBits - 1)
+// equal buckets, so any recorded value is known to within 1/64 (1.6%) over
+// the whole uint64_t range, with a fixed 15KB of counts and no allocation.
+//
+// Shared by the platform layers and tools, so no game types in here.
+//
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+constexpr uint32_t kHistogramSubBucketBits = 7;
+constexpr uint32_t kHistogramSubBucketHalf =
+        1u << (kHistogramSubBucketBits - 1);
+constexpr uint32_t kHistogramBucketCount =
+        (64 - kHistogramSubBucketBits + 2) * kHistogramSubBucketHalf;
+
+struct histogram
+{
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint32_t buckets[kHistogramBucketCount];
+};
+
+inline uint32_t histogram_msb(uint64_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return 63 - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+inline uint32_t histogram_bucket_index(uint64_t value)
+{
+    if (value < (1u << kHistogramSubBucketBits))
+    {
+        return static_cast<uint32_t>(value);
+    }
+    // value >> shift lands in [half, 2 * half), one band of half buckets
+    // per shift after the exact ones
+    uint32_t shift = histogram_msb(value) - kHistogramSubBucketBits + 1;
+    return (shift << (kHistogramSubBucketBits - 1)) +
+            static_cast<uint32_t>(value >> shift);
+}
+
+// largest value that lands in the bucket
+inline uint64_t histogram_bucket_max(uint32_t index)
+{
+    if (index < (1u << kHistogramSubBucketBits))
+    {
+        return index;
+    }
+    uint32_t shift = (index >> (kHistogramSubBucketBits - 1)) - 1;
+    uint64_t mantissa = index - (shift << (kHistogramSubBucketBits - 1));
+    return (mantissa << shift) + ((1ULL << shift) - 1);
+}
+
+inline void histogram_reset(histogram *hist)
+{
+    std::memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+inline void histogram_record(histogram *hist, uint64_t value)
+{
+    ++hist->buckets[histogram_bucket_index(value)];
+    ++hist->count;
+    hist->sum += value;
+    hist->min = value < hist->min ? value : hist->min;
+    hist->max = value > hist->max ? value : hist->max;
+}
+
+inline void histogram_merge(histogram *dest, const histogram *source)
+{
+    for (uint32_t index = 0; index < kHistogramBucketCount; ++index)
+    {
+        dest->buckets[index] += source->buckets[index];
+    }
+    dest->count += source->count;
+    dest->sum += source->sum;
+    dest->min = source->min < dest->min ? source->min : dest->min;
+    dest->max = source->max > dest->max ? source->max : dest->max;
+}
+
+// smallest bucket bound at or above the given fraction (0..1) of the values,
+// clamped to the exact min and max; 0 when empty
+inline uint64_t histogram_percentile(const histogram *hist, double fraction)
+{
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(
+        fraction * static_cast<double>(hist->count) + 0.5);
+    target = target < 1 ? 1 : target;
+    uint64_t result = hist->max;
+    uint64_t seen = 0;
+    for (uint32_t index = 0; index < kHistogramBucketCount; ++index)
+    {
+        seen += hist->buckets[index];
+        if (seen >= target)
+        {
+            result = histogram_bucket_max(index);
+            break;
+        }
+    }
+    result = result < hist->min ? hist->min : result;
+    result = result > hist->max ? hist->max : result;
+    return result;
+}
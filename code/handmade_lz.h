@@ -0,0 +1,268 @@
+#pragma once
+
+//
+// LZ block compression, LZ4 block format.
+//
+// A block is a run of sequences, each:
+//   token        high 4 bits literal length, low 4 bits match length - 4;
+//                15 means more length bytes follow (each adds 0..255, a byte
+//                below 255 ends it)
+//   literals
+//   offset       2 bytes little endian, distance back to the match
+//   (match length bytes)
+// The last sequence has literals only. lz_compress is meant for offline
+// tools; lz_decompress runs in the game and checks every bound, since the
+// input comes from a file.
+//
+// Self-contained so the asset packer can use it without any game types.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+
+constexpr uint32_t kLzMinMatch = 4;
+constexpr uint32_t kLzMaxOffset = 65535;
+// the format requires the last 5 bytes to be literals and the last match to
+// start at least 12 bytes before the end
+constexpr size_t kLzLastLiterals = 5;
+constexpr size_t kLzMatchFindLimit = 12;
+constexpr uint32_t kLzHashBits = 16;
+constexpr uint32_t kLzHashSize = 1u << kLzHashBits;
+
+inline size_t lz_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+inline uint32_t lz_read_u32(const uint8_t *at)
+{
+    uint32_t result;
+    std::memcpy(&result, at, sizeof(result));
+    return result;
+}
+
+inline uint32_t lz_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - kLzHashBits);
+}
+
+inline uint8_t *lz_write_length(uint8_t *out, size_t length)
+{
+    while (length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+// hash_table must hold kLzHashSize entries; returns the compressed size, or 0
+// if it doesn't fit in dest_capacity (lz_compress_bound always fits)
+inline size_t lz_compress(const uint8_t *source, size_t source_size,
+                          uint8_t *dest, size_t dest_capacity,
+                          uint32_t *hash_table)
+{
+    if (dest_capacity < lz_compress_bound(source_size))
+    {
+        return 0;
+    }
+    std::memset(hash_table, 0, kLzHashSize * sizeof(uint32_t));
+
+    const uint8_t *in = source;
+    const uint8_t *in_end = source + source_size;
+    const uint8_t *literal_start = source;
+    uint8_t *out = dest;
+
+    if (source_size > kLzMatchFindLimit)
+    {
+        const uint8_t *match_limit = in_end - kLzMatchFindLimit;
+        // position 0 can't be told apart from an empty entry, start at 1
+        ++in;
+        // step further the longer nothing matches, so incompressible data
+        // goes by quickly
+        uint32_t misses = 0;
+        while (in < match_limit)
+        {
+            uint32_t sequence = lz_read_u32(in);
+            uint32_t hash = lz_hash(sequence);
+            const uint8_t *match = source + hash_table[hash];
+            hash_table[hash] = static_cast<uint32_t>(in - source);
+            if (match == source ||
+                in - match > static_cast<ptrdiff_t>(kLzMaxOffset) ||
+                lz_read_u32(match) != sequence)
+            {
+                in += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // extend backwards over pending literals, then forwards
+            while (in > literal_start && match > source && in[-1] == match[-1])
+            {
+                --in;
+                --match;
+            }
+            const uint8_t *match_end = in + kLzMinMatch;
+            const uint8_t *extend_limit = in_end - kLzLastLiterals;
+            while (match_end < extend_limit &&
+                   *match_end == match[match_end - in])
+            {
+                ++match_end;
+            }
+
+            size_t literal_length = static_cast<size_t>(in - literal_start);
+            size_t match_length = static_cast<size_t>(match_end - in) -
+                    kLzMinMatch;
+            uint8_t *token = out++;
+            *token = static_cast<uint8_t>(
+                ((literal_length < 15 ? literal_length : 15) << 4) |
+                (match_length < 15 ? match_length : 15));
+            if (literal_length >= 15)
+            {
+                out = lz_write_length(out, literal_length - 15);
+            }
+            std::memcpy(out, literal_start, literal_length);
+            out += literal_length;
+            uint16_t offset = static_cast<uint16_t>(in - match);
+            *out++ = static_cast<uint8_t>(offset);
+            *out++ = static_cast<uint8_t>(offset >> 8);
+            if (match_length >= 15)
+            {
+                out = lz_write_length(out, match_length - 15);
+            }
+
+            in = match_end;
+            literal_start = in;
+        }
+    }
+
+    // last literals
+    size_t literal_length = static_cast<size_t>(in_end - literal_start);
+    *out++ = static_cast<uint8_t>(
+        (literal_length < 15 ? literal_length : 15) << 4);
+    if (literal_length >= 15)
+    {
+        out = lz_write_length(out, literal_length - 15);
+    }
+    std::memcpy(out, literal_start, literal_length);
+    out += literal_length;
+    return static_cast<size_t>(out - dest);
+}
+
+// returns false if the block is corrupt or doesn't decompress to exactly
+// dest_size bytes
+inline bool lz_decompress(const uint8_t *source, size_t source_size,
+                          uint8_t *dest, size_t dest_size)
+{
+    const uint8_t *in = source;
+    const uint8_t *in_end = source + source_size;
+    uint8_t *out = dest;
+    uint8_t *out_end = dest + dest_size;
+
+    while (in < in_end)
+    {
+        uint32_t token = *in++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15)
+        {
+            uint32_t length_byte;
+            do
+            {
+                if (in == in_end)
+                {
+                    return false;
+                }
+                length_byte = *in++;
+                literal_length += length_byte;
+            } while (length_byte == 255);
+        }
+        if (literal_length > static_cast<size_t>(in_end - in) ||
+            literal_length > static_cast<size_t>(out_end - out))
+        {
+            return false;
+        }
+        if (literal_length <= 16 && in_end - in >= 16 && out_end - out >= 16)
+        {
+            // short literal runs are the common case, copy a fixed 16 bytes
+            std::memcpy(out, in, 16);
+        }
+        else
+        {
+            std::memcpy(out, in, literal_length);
+        }
+        in += literal_length;
+        out += literal_length;
+
+        if (in == in_end)
+        {
+            // last sequence has no match
+            break;
+        }
+
+        if (in_end - in < 2)
+        {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(in[0] | (in[1] << 8));
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - dest))
+        {
+            return false;
+        }
+        size_t match_length = token & 15;
+        if (match_length == 15)
+        {
+            uint32_t length_byte;
+            do
+            {
+                if (in == in_end)
+                {
+                    return false;
+                }
+                length_byte = *in++;
+                match_length += length_byte;
+            } while (length_byte == 255);
+        }
+        match_length += kLzMinMatch;
+        if (match_length > static_cast<size_t>(out_end - out))
+        {
+            return false;
+        }
+
+        const uint8_t *match = out - offset;
+        uint8_t *copy_end = out + match_length;
+        if (offset < 8)
+        {
+            // an overlapping match repeats a pattern of offset bytes; copy
+            // byte by byte until the source is a whole number of patterns
+            // and at least 8 bytes back, then it can go wide
+            size_t distance = offset * ((8 + offset - 1) / offset);
+            uint8_t *pattern_end = out + std::min(distance, match_length);
+            while (out < pattern_end)
+            {
+                *out++ = *match++;
+            }
+            match = out - distance;
+        }
+        // 8 bytes at a time, may write up to 7 bytes past the match which the
+        // following sequences overwrite
+        while (out < copy_end && static_cast<size_t>(out_end - out) >= 8)
+        {
+            std::memcpy(out, match, 8);
+            out += 8;
+            match += 8;
+        }
+        // near the end of the output, finish byte by byte
+        while (out < copy_end)
+        {
+            *out++ = *match++;
+        }
+        out = copy_end;
+    }
+    return out == out_end;
+}
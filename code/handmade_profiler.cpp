@@ -0,0 +1,329 @@
+#include "handmade.h"
+
+#if HANDMADE_DIAGNOSTIC
+
+// the game thread's bookkeeping for one thread's ring
+struct profiler_open_block
+{
+    uint64_t begin_tsc;
+    const char *name;
+    const char *file;
+    uint32_t line;
+    uint32_t node;
+};
+
+struct profiler_thread_state
+{
+    uint32_t depth;
+    profiler_open_block stack[kProfilerMaxDepth];
+};
+
+struct profiler_state
+{
+    std::atomic<uint32_t> thread_count;
+    profiler_thread_buffer buffers[kProfilerMaxThreads];
+
+    // game thread only from here on
+    profiler_thread_state threads[kProfilerMaxThreads];
+    uint64_t frame_begin_tsc;
+    // one is being built while the other is reported
+    uint32_t last_frame_index;
+    profiler_frame frames[2];
+    profiler_trace_proc *trace_proc;
+    void *trace_user_data;
+};
+
+global_variable profiler_state g_profiler {};
+// -1 before the thread's first event, -2 when there's no buffer left
+global_variable thread_local int32_t g_profiler_thread_index = -1;
+
+internal profiler_thread_buffer *profiler_get_thread_buffer()
+{
+    if (g_profiler_thread_index == -1)
+    {
+        uint32_t index = g_profiler.thread_count.fetch_add(
+            1, std::memory_order_acq_rel);
+        g_profiler_thread_index = index < kProfilerMaxThreads ?
+                static_cast<int32_t>(index) : -2;
+    }
+    return g_profiler_thread_index >= 0 ?
+            &g_profiler.buffers[g_profiler_thread_index] : nullptr;
+}
+
+internal void profiler_name_thread(const char *name)
+{
+    profiler_thread_buffer *buffer = profiler_get_thread_buffer();
+    if (buffer)
+    {
+        buffer->name = name;
+    }
+}
+
+internal bool32 profiler_record_begin(const char *name, const char *file,
+                                      uint32_t line)
+{
+    profiler_thread_buffer *buffer = profiler_get_thread_buffer();
+    if (!buffer)
+    {
+        return false;
+    }
+    uint32_t write_index = buffer->write_index.load(std::memory_order_relaxed);
+    uint32_t used = write_index -
+            buffer->read_index.load(std::memory_order_acquire);
+    // keep room for this block's end and the end of every open block, so
+    // ends always fit and the tree stays balanced; everything nested in a
+    // dropped block goes too, or it would show up under the wrong parent
+    if (buffer->dropped_depth ||
+        buffer->open_depth == kProfilerMaxDepth ||
+        kProfilerEventCount - used < buffer->open_depth + 2)
+    {
+        ++buffer->dropped_depth;
+        buffer->dropped_count.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    profiler_event *event =
+            &buffer->events[write_index & (kProfilerEventCount - 1)];
+    event->name = name;
+    event->file = file;
+    event->line = line;
+    event->type = profiler_event_begin;
+    ++buffer->open_depth;
+    // last, so none of the bookkeeping is timed
+    event->tsc = read_tsc();
+    buffer->write_index.store(write_index + 1, std::memory_order_release);
+    return true;
+}
+
+internal void profiler_record_end(bool32 recorded)
+{
+    uint64_t tsc = read_tsc();
+    if (g_profiler_thread_index < 0)
+    {
+        return;
+    }
+    profiler_thread_buffer *buffer =
+            &g_profiler.buffers[g_profiler_thread_index];
+    if (!recorded)
+    {
+        --buffer->dropped_depth;
+        return;
+    }
+    uint32_t write_index = buffer->write_index.load(std::memory_order_relaxed);
+    profiler_event *event =
+            &buffer->events[write_index & (kProfilerEventCount - 1)];
+    event->tsc = tsc;
+    event->type = profiler_event_end;
+    --buffer->open_depth;
+    buffer->write_index.store(write_index + 1, std::memory_order_release);
+}
+
+// finds or adds the child of parent for a block; 0 once the frame is full
+internal uint32_t profiler_get_child(profiler_frame *frame, uint32_t parent,
+                                     const char *name, const char *file,
+                                     uint32_t line)
+{
+    if (!parent)
+    {
+        return 0;
+    }
+    uint32_t *link = &frame->nodes[parent].first_child;
+    while (*link)
+    {
+        profiler_node *child = &frame->nodes[*link];
+        if (child->name == name && child->file == file && child->line == line)
+        {
+            return *link;
+        }
+        link = &child->next_sibling;
+    }
+    if (frame->node_count == kProfilerMaxNodes)
+    {
+        return 0;
+    }
+    uint32_t result = frame->node_count++;
+    profiler_node *node = &frame->nodes[result];
+    *node = {};
+    node->name = name;
+    node->file = file;
+    node->line = line;
+    node->parent = parent;
+    *link = result;
+    return result;
+}
+
+internal void profiler_end_frame()
+{
+    uint64_t frame_end_tsc = read_tsc();
+    uint32_t frame_index = g_profiler.last_frame_index ^ 1;
+    profiler_frame *frame = &g_profiler.frames[frame_index];
+    frame->begin_tsc = g_profiler.frame_begin_tsc ?
+            g_profiler.frame_begin_tsc : frame_end_tsc;
+    frame->end_tsc = frame_end_tsc;
+    frame->dropped_count = 0;
+    frame->node_count = 1;
+
+    uint32_t thread_count = std::min(
+        g_profiler.thread_count.load(std::memory_order_acquire),
+        kProfilerMaxThreads);
+    for (uint32_t thread_index = 0; thread_index < thread_count; ++thread_index)
+    {
+        profiler_thread_buffer *buffer = &g_profiler.buffers[thread_index];
+        profiler_thread_state *state = &g_profiler.threads[thread_index];
+        frame->thread_roots[thread_index] = 0;
+        uint32_t read_index = buffer->read_index.load(
+            std::memory_order_relaxed);
+        uint32_t write_index = buffer->write_index.load(
+            std::memory_order_acquire);
+        if (read_index == write_index && state->depth == 0)
+        {
+            continue;
+        }
+        frame->dropped_count += buffer->dropped_count.exchange(
+            0, std::memory_order_relaxed);
+        uint32_t root = 0;
+        if (frame->node_count < kProfilerMaxNodes)
+        {
+            root = frame->node_count++;
+            frame->nodes[root] = {};
+        }
+        frame->thread_roots[thread_index] = root;
+
+        // blocks still open from earlier frames carry over, their whole time
+        // lands in the frame they end in
+        for (uint32_t depth = 0; depth < state->depth; ++depth)
+        {
+            profiler_open_block *block = &state->stack[depth];
+            uint32_t parent = depth ? state->stack[depth - 1].node : root;
+            block->node = profiler_get_child(frame, parent, block->name,
+                                             block->file, block->line);
+        }
+
+        for (; read_index != write_index; ++read_index)
+        {
+            const profiler_event *event =
+                    &buffer->events[read_index & (kProfilerEventCount - 1)];
+            if (event->type == profiler_event_begin)
+            {
+                HANDMADE_ASSERT(state->depth < kProfilerMaxDepth);
+                uint32_t parent = state->depth ?
+                        state->stack[state->depth - 1].node : root;
+                profiler_open_block *block = &state->stack[state->depth++];
+                block->begin_tsc = event->tsc;
+                block->name = event->name;
+                block->file = event->file;
+                block->line = event->line;
+                block->node = profiler_get_child(frame, parent, event->name,
+                                                 event->file, event->line);
+                if (block->node)
+                {
+                    ++frame->nodes[block->node].hit_count;
+                }
+            }
+            else
+            {
+                HANDMADE_ASSERT(state->depth > 0);
+                profiler_open_block *block = &state->stack[--state->depth];
+                uint64_t cycles = event->tsc - block->begin_tsc;
+                if (g_profiler.trace_proc)
+                {
+                    profiler_trace_event trace_event {
+                        block->name, block->begin_tsc, event->tsc, thread_index
+                    };
+                    g_profiler.trace_proc(&trace_event,
+                                          g_profiler.trace_user_data);
+                }
+                if (block->node)
+                {
+                    profiler_node *node = &frame->nodes[block->node];
+                    node->total_cycles += cycles;
+                    if (node->parent)
+                    {
+                        frame->nodes[node->parent].child_cycles += cycles;
+                    }
+                }
+            }
+        }
+        buffer->read_index.store(read_index, std::memory_order_release);
+    }
+    for (uint32_t thread_index = thread_count;
+         thread_index < kProfilerMaxThreads;
+         ++thread_index)
+    {
+        frame->thread_roots[thread_index] = 0;
+    }
+
+    if (g_profiler.trace_proc && profiler_get_thread_buffer())
+    {
+        profiler_trace_event trace_event {
+            "frame", frame->begin_tsc, frame->end_tsc,
+            static_cast<uint32_t>(g_profiler_thread_index)
+        };
+        g_profiler.trace_proc(&trace_event, g_profiler.trace_user_data);
+    }
+
+    g_profiler.last_frame_index = frame_index;
+    g_profiler.frame_begin_tsc = frame_end_tsc;
+}
+
+// inline rather than internal, only some platform layers export a trace
+inline void profiler_set_trace_proc(profiler_trace_proc *proc, void *user_data)
+{
+    g_profiler.trace_proc = proc;
+    g_profiler.trace_user_data = user_data;
+}
+
+inline const char *profiler_get_thread_name(uint32_t thread_index)
+{
+    return thread_index < kProfilerMaxThreads ?
+            g_profiler.buffers[thread_index].name : nullptr;
+}
+
+internal const profiler_frame *profiler_get_last_frame()
+{
+    return &g_profiler.frames[g_profiler.last_frame_index];
+}
+
+internal void profiler_print_node(const profiler_frame *frame,
+                                  uint32_t node_index, uint32_t depth,
+                                  const timer_info *timer)
+{
+    for (uint32_t child_index = frame->nodes[node_index].first_child;
+         child_index;
+         child_index = frame->nodes[child_index].next_sibling)
+    {
+        const profiler_node *node = &frame->nodes[child_index];
+        uint64_t self_cycles = node->total_cycles - node->child_cycles;
+        printf("%*s%-*s %6u %10" PRIu64 " %10" PRIu64 " %9.3f %9.3f\n",
+               static_cast<int>(depth * 2), "",
+               static_cast<int>(40 - std::min(depth * 2, 38u)), node->name,
+               node->hit_count, node->total_cycles, self_cycles,
+               ticks_to_ms(timer, node->total_cycles),
+               ticks_to_ms(timer, self_cycles));
+        profiler_print_node(frame, child_index, depth + 1, timer);
+    }
+}
+
+// cycles are TSC ticks, so ms are only exact when timer->uses_tsc
+internal void profiler_print_frame(const profiler_frame *frame,
+                                   const timer_info *timer)
+{
+    printf("frame: %.3f ms, %u events dropped\n",
+           ticks_to_ms(timer, frame->end_tsc - frame->begin_tsc),
+           frame->dropped_count);
+    printf("%-40s %6s %10s %10s %9s %9s\n", "block", "hits", "total cy",
+           "self cy", "total ms", "self ms");
+    for (uint32_t thread_index = 0;
+         thread_index < kProfilerMaxThreads;
+         ++thread_index)
+    {
+        uint32_t root = frame->thread_roots[thread_index];
+        if (root)
+        {
+            const char *name = g_profiler.buffers[thread_index].name;
+            printf("[%s %u]\n", name ? name : "thread", thread_index);
+            profiler_print_node(frame, root, 1, timer);
+        }
+    }
+}
+
+#endif  // HANDMADE_DIAGNOSTIC
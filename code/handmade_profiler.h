@@ -0,0 +1,141 @@
+#pragma once
+
+//
+// In-frame profiler.
+//
+// TIMED_BLOCK("name") times the rest of the enclosing scope with the TSC. It
+// works on any thread: events go into a lock-free ring owned by the thread,
+// and the game thread drains every ring once a frame in profiler_end_frame,
+// building a call tree per thread with hit counts and self and total cycles.
+//
+// Everything here compiles out without HANDMADE_DIAGNOSTIC, so call sites
+// other than TIMED_BLOCK go inside #if HANDMADE_DIAGNOSTIC.
+//
+
+#if HANDMADE_DIAGNOSTIC
+
+#include <atomic>
+#include <cstdio>
+
+// game, audio, loader and a worker per core
+constexpr uint32_t kProfilerMaxThreads = 72;
+// per thread and frame, must be a power of 2
+constexpr uint32_t kProfilerEventCount = 8192;
+constexpr uint32_t kProfilerMaxDepth = 64;
+constexpr uint32_t kProfilerMaxNodes = 4096;
+
+enum profiler_event_type : uint32_t
+{
+    profiler_event_begin,
+    profiler_event_end,
+};
+
+struct profiler_event
+{
+    uint64_t tsc;
+    // block identity, only set on begin
+    const char *name;
+    const char *file;
+    uint32_t line;
+    profiler_event_type type;
+};
+
+// written by the owning thread, read by the game thread
+struct profiler_thread_buffer
+{
+    const char *name;
+    // blocks begun and not ended yet, and blocks skipped because they were
+    // dropped or nested in a dropped one; owner only
+    uint32_t open_depth;
+    uint32_t dropped_depth;
+    std::atomic<uint32_t> dropped_count;
+    // free running, wrapped with & (kProfilerEventCount - 1) on access
+    alignas(64) std::atomic<uint32_t> write_index;
+    alignas(64) std::atomic<uint32_t> read_index;
+    profiler_event events[kProfilerEventCount];
+};
+
+internal bool32 profiler_record_begin(const char *name, const char *file,
+                                      uint32_t line);
+// takes what the matching begin returned
+internal void profiler_record_end(bool32 recorded);
+// shows up in reports instead of the thread number
+internal void profiler_name_thread(const char *name);
+
+struct timed_block
+{
+    bool32 recorded;
+
+    timed_block(const char *name, const char *file, uint32_t line)
+        : recorded(profiler_record_begin(name, file, line))
+    {
+    }
+
+    ~timed_block()
+    {
+        profiler_record_end(recorded);
+    }
+};
+
+#define HANDMADE_CONCAT_(a, b) a##b
+#define HANDMADE_CONCAT(a, b) HANDMADE_CONCAT_(a, b)
+#define TIMED_BLOCK(name)                                   \
+    timed_block HANDMADE_CONCAT(timed_block_, __LINE__)(    \
+        name, __FILE__, __LINE__)
+
+// call tree of one frame; node 0 is unused so 0 can mean none
+struct profiler_node
+{
+    const char *name;
+    const char *file;
+    uint32_t line;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    uint32_t hit_count;
+    uint64_t total_cycles;
+    uint64_t child_cycles;
+};
+
+struct profiler_frame
+{
+    uint64_t begin_tsc;
+    uint64_t end_tsc;
+    uint32_t dropped_count;
+    uint32_t node_count;
+    // root node per thread, 0 if the thread had nothing this frame
+    uint32_t thread_roots[kProfilerMaxThreads];
+    profiler_node nodes[kProfilerMaxNodes];
+};
+
+internal void profiler_end_frame();
+internal const profiler_frame *profiler_get_last_frame();
+internal void profiler_print_frame(const profiler_frame *frame,
+                                   const timer_info *timer);
+
+// every block profiler_end_frame finishes, for timeline views; the frame
+// itself comes through as "frame" on the thread ending it
+struct profiler_trace_event
+{
+    const char *name;
+    uint64_t begin_tsc;
+    uint64_t end_tsc;
+    uint32_t thread_index;
+};
+
+#define PROFILER_TRACE_PROC(name) \
+    void name(const profiler_trace_event *event, void *user_data)
+typedef PROFILER_TRACE_PROC(profiler_trace_proc);
+
+// called on the thread running profiler_end_frame, null to stop
+inline void profiler_set_trace_proc(profiler_trace_proc *proc,
+                                    void *user_data);
+// null if the thread never named itself; safe to call from the thread
+// running profiler_end_frame for any thread that has recorded something
+inline const char *profiler_get_thread_name(uint32_t thread_index);
+
+#else  // HANDMADE_DIAGNOSTIC
+
+#define TIMED_BLOCK(name)
+
+#endif  // HANDMADE_DIAGNOSTIC
@@ -0,0 +1,170 @@
+/*
+  Measures handmade_lz.h on real files and what it does to asset load time.
+
+  Usage: lz_bench [--disk-mbps <n>] <file>...
+
+  Load time is modelled as reading the stored bytes at the given disk speed
+  (default 500 MB/s) plus decompression, against reading the raw bytes.
+*/
+
+#include "handmade_lz.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define internal static
+
+constexpr double kMinBenchSeconds = 0.5;
+constexpr double kDefaultDiskMbps = 500.0;
+
+struct bench_result
+{
+    size_t size;
+    size_t compressed_size;
+    double compress_seconds;
+    double decompress_seconds;
+};
+
+internal double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+internal uint8_t *read_entire_file(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        perror(filename);
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *result = nullptr;
+    if (file_size > 0)
+    {
+        *size = static_cast<size_t>(file_size);
+        result = static_cast<uint8_t*>(malloc(*size));
+        if (fread(result, *size, 1, file) != 1)
+        {
+            perror(filename);
+            free(result);
+            result = nullptr;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+// runs each side for at least kMinBenchSeconds and keeps the per run average
+internal bool bench_file(const uint8_t *data, size_t size,
+                         uint32_t *hash_table, bench_result *result)
+{
+    size_t capacity = lz_compress_bound(size);
+    uint8_t *compressed = static_cast<uint8_t*>(malloc(capacity));
+    uint8_t *decompressed = static_cast<uint8_t*>(malloc(size));
+
+    result->size = size;
+    uint32_t runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        result->compressed_size = lz_compress(data, size, compressed, capacity,
+                                              hash_table);
+        ++runs;
+    } while (seconds_since(start) < kMinBenchSeconds);
+    result->compress_seconds = seconds_since(start) / runs;
+
+    bool ok = true;
+    runs = 0;
+    start = std::chrono::steady_clock::now();
+    do
+    {
+        ok = lz_decompress(compressed, result->compressed_size,
+                           decompressed, size);
+        ++runs;
+    } while (ok && seconds_since(start) < kMinBenchSeconds);
+    result->decompress_seconds = seconds_since(start) / runs;
+
+    ok = ok && memcmp(data, decompressed, size) == 0;
+    free(decompressed);
+    free(compressed);
+    return ok;
+}
+
+internal void print_result(const char *name, const bench_result *result,
+                           double disk_bytes_per_sec)
+{
+    double size = static_cast<double>(result->size);
+    double compressed_size = static_cast<double>(result->compressed_size);
+    double raw_load = size / disk_bytes_per_sec;
+    double lz_load = compressed_size / disk_bytes_per_sec +
+            result->decompress_seconds;
+    printf("%-24s %12zu %6.1f%% %8.2f %8.2f %9.2fms %9.2fms %7.2fx\n",
+           name, result->size, 100.0 * compressed_size / size,
+           size / result->compress_seconds / 1e9,
+           size / result->decompress_seconds / 1e9,
+           raw_load * 1000.0, lz_load * 1000.0, raw_load / lz_load);
+}
+
+int main(int argc, char **argv)
+{
+    double disk_mbps = kDefaultDiskMbps;
+    int arg_index = 1;
+    if (arg_index + 1 < argc && strcmp(argv[arg_index], "--disk-mbps") == 0)
+    {
+        disk_mbps = atof(argv[arg_index + 1]);
+        arg_index += 2;
+    }
+    if (arg_index >= argc || disk_mbps <= 0.0)
+    {
+        fprintf(stderr, "Usage: %s [--disk-mbps <n>] <file>...\n", argv[0]);
+        return 1;
+    }
+    double disk_bytes_per_sec = disk_mbps * 1e6;
+
+    uint32_t *hash_table = static_cast<uint32_t*>(
+        malloc(kLzHashSize * sizeof(uint32_t)));
+    printf("%-24s %12s %7s %8s %8s %11s %11s %8s\n", "file", "bytes", "ratio",
+           "comp", "decomp", "raw load", "lz load", "speedup");
+    printf("%-24s %12s %7s %8s %8s %11s %11s %8s\n", "", "", "", "GB/s", "GB/s",
+           "", "", "");
+
+    bench_result total {};
+    bool succeeded = true;
+    for (; arg_index < argc; ++arg_index)
+    {
+        size_t size = 0;
+        uint8_t *data = read_entire_file(argv[arg_index], &size);
+        if (!data)
+        {
+            succeeded = false;
+            continue;
+        }
+        bench_result result {};
+        if (bench_file(data, size, hash_table, &result))
+        {
+            print_result(argv[arg_index], &result, disk_bytes_per_sec);
+            total.size += result.size;
+            total.compressed_size += result.compressed_size;
+            total.compress_seconds += result.compress_seconds;
+            total.decompress_seconds += result.decompress_seconds;
+        }
+        else
+        {
+            fprintf(stderr, "%s: round trip failed\n", argv[arg_index]);
+            succeeded = false;
+        }
+        free(data);
+    }
+    if (total.size)
+    {
+        print_result("total", &total, disk_bytes_per_sec);
+    }
+    free(hash_table);
+    return succeeded ? 0 : 1;
+}
@@ -4,9 +4,7 @@
   - saved game locations
   - getting a handle to our own exe file
   - asset loading path
-  - threading
   - raw input (support for multiple keyboards)
-  - sleep/timeBeginPeriod
   - ClipCursor() (for multimonitor support)
   - fullscreen support
   - WM_SETCURSOR (control cursor visibility)
@@ -42,17 +40,216 @@
 
 #include "handmade.h"
 #include "handmade.cpp"
+#include "handmade_controller_db.h"
 
 /*
   Platform specific stuff below
 */
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
-#include <chrono>
+#include <atomic>
 // #include <iostream>
 
-typedef std::chrono::duration<real32, std::ratio<1, 1000> > chrono_duration_ms;
+
+#if HANDMADE_ALLOC_CHECK
+
+/*
+  Steady-state zero-allocation check.
+
+  Every allocation made through platform_alloc_zeroed, malloc family (glibc
+  only), operator new and SDL_malloc is counted. Once the frame loop has run
+  for kAllocCheckWarmupFrames frames the check is armed, and from then on each
+  allocation is reported to stderr with a backtrace. The frame loop is expected
+  to not allocate at all.
+*/
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#include <unistd.h>
+#endif  // __GLIBC__
+
+constexpr uint32_t kAllocCheckWarmupFrames = 120;
+// only the first few steady state allocations get a backtrace; the rest are
+// just counted so a per-frame leak doesn't flood the console
+constexpr uint32_t kAllocCheckMaxReports = 16;
+constexpr int32_t kAllocCheckMaxBacktraceDepth = 32;
+
+enum alloc_check_source
+{
+    alloc_check_source_platform,
+    alloc_check_source_malloc,
+    alloc_check_source_new,
+    alloc_check_source_sdl,
+
+    alloc_check_source_count
+};
+
+global_variable const char *kAllocCheckSourceNames[alloc_check_source_count] =
+{
+    "platform_alloc_zeroed",
+    "malloc",
+    "operator new",
+    "SDL_malloc",
+};
+
+struct alloc_check_state
+{
+    std::atomic<bool> armed;
+    std::atomic<uint32_t> num_reports;
+    std::atomic<uint64_t> total_counts[alloc_check_source_count];
+    std::atomic<uint64_t> steady_counts[alloc_check_source_count];
+};
+
+global_variable alloc_check_state g_alloc_check {};
+// > 0 while inside an allocation wrapper or the report, so the allocations
+// they make themselves are not counted twice
+global_variable thread_local int32_t g_alloc_check_depth = 0;
+
+struct alloc_check_scope
+{
+    alloc_check_scope() { ++g_alloc_check_depth; }
+    ~alloc_check_scope() { --g_alloc_check_depth; }
+};
+
+internal void alloc_check_report(alloc_check_source source, size_t size)
+{
+#if defined(__GLIBC__)
+    char msg[128];
+    int msg_len = snprintf(msg, sizeof(msg),
+                           "alloc check: %s(%" PRIuS ") in frame loop\n",
+                           kAllocCheckSourceNames[source], size);
+    if (msg_len > 0)
+    {
+        // write directly, stdio may allocate
+        ssize_t written = write(STDERR_FILENO, msg,
+                                std::min(static_cast<size_t>(msg_len),
+                                         sizeof(msg) - 1));
+        (void)written;
+    }
+    void *frames[kAllocCheckMaxBacktraceDepth];
+    int num_frames = backtrace(frames, kAllocCheckMaxBacktraceDepth);
+    // skip alloc_check_report and alloc_check_record
+    backtrace_symbols_fd(frames + 2, std::max(0, num_frames - 2), STDERR_FILENO);
+#else
+    fprintf(stderr, "alloc check: %s(%" PRIuS ") in frame loop\n",
+            kAllocCheckSourceNames[source], size);
+#endif  // __GLIBC__
+}
+
+internal void alloc_check_record(alloc_check_source source, size_t size)
+{
+    if (g_alloc_check_depth > 0)
+    {
+        return;
+    }
+    alloc_check_scope scope;
+    g_alloc_check.total_counts[source].fetch_add(1, std::memory_order_relaxed);
+    if (g_alloc_check.armed.load(std::memory_order_relaxed))
+    {
+        g_alloc_check.steady_counts[source].fetch_add(
+            1, std::memory_order_relaxed);
+        if (g_alloc_check.num_reports.fetch_add(
+                1, std::memory_order_relaxed) < kAllocCheckMaxReports)
+        {
+            alloc_check_report(source, size);
+        }
+    }
+}
+
+internal void alloc_check_arm(bool armed)
+{
+#if defined(__GLIBC__)
+    if (armed)
+    {
+        // first call to backtrace loads libgcc which allocates, get that out
+        // of the way before arming
+        alloc_check_scope scope;
+        void *frame;
+        backtrace(&frame, 1);
+    }
+#endif  // __GLIBC__
+    g_alloc_check.armed.store(armed, std::memory_order_relaxed);
+}
+
+internal void alloc_check_print_summary()
+{
+    printf("alloc check summary (total / after %u warmup frames):\n",
+           kAllocCheckWarmupFrames);
+    for (int32_t source = 0; source < alloc_check_source_count; ++source)
+    {
+        printf("  %-22s %10" PRIu64 " / %" PRIu64 "\n",
+               kAllocCheckSourceNames[source],
+               g_alloc_check.total_counts[source].load(),
+               g_alloc_check.steady_counts[source].load());
+    }
+}
+
+#if defined(__GLIBC__)
+// interpose the malloc family; this also catches allocations made inside
+// shared libraries (SDL, the audio and video drivers) as the executable's
+// symbols take precedence
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    alloc_check_record(alloc_check_source_malloc, size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    alloc_check_record(alloc_check_source_malloc, count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    alloc_check_record(alloc_check_source_malloc, size);
+    return __libc_realloc(ptr, size);
+}
+}
+#endif  // __GLIBC__
+
+void *operator new(size_t size)
+{
+    alloc_check_record(alloc_check_source_new, size);
+    void *result = nullptr;
+    {
+        alloc_check_scope scope;
+        result = std::malloc(size);
+    }
+    if (!result)
+    {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+#endif  // HANDMADE_ALLOC_CHECK
 
 
 #ifdef WIN32
@@ -63,6 +260,23 @@ typedef std::chrono::duration<real32, std::ratio<1, 1000> > chrono_duration_ms;
 #include <windows.h>
 #include <intrin.h>
 
+internal uint64_t platform_read_os_clock_ns()
+{
+    local_persist int64_t frequency = 0;
+    if (!frequency)
+    {
+        LARGE_INTEGER result;
+        QueryPerformanceFrequency(&result);
+        frequency = result.QuadPart;
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // split so counter * 1e9 can't overflow
+    uint64_t seconds = static_cast<uint64_t>(counter.QuadPart / frequency);
+    uint64_t remainder = static_cast<uint64_t>(counter.QuadPart % frequency);
+    return seconds * 1000000000ULL +
+            remainder * 1000000000ULL / static_cast<uint64_t>(frequency);
+}
 
 internal void* platform_alloc_zeroed(void *base_addr, size_t length)
 {
@@ -70,6 +284,9 @@ internal void* platform_alloc_zeroed(void *base_addr, size_t length)
     // commited to page boundary (4KB), but the rest are wasted space
     // memory auto clears to 0
     // freed automatically when app terminates
+#if HANDMADE_ALLOC_CHECK
+    alloc_check_record(alloc_check_source_platform, length);
+#endif  // HANDMADE_ALLOC_CHECK
     void *memory = VirtualAlloc(base_addr, length,
                                 MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
     HANDMADE_ASSERT(memory);
@@ -81,17 +298,71 @@ internal void platform_free(void *memory, size_t)
     VirtualFree(memory, 0, MEM_RELEASE);
 }
 
+internal platform_file_view platform_map_file(const char *filename, bool32)
+{
+    // NOTE: no prefetch, PrefetchVirtualMemory needs Windows 8
+    platform_file_view result {};
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER file_size {};
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                                0, 0, nullptr);
+            if (mapping)
+            {
+                result.content = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (result.content)
+                {
+                    result.size = static_cast<uint64_t>(file_size.QuadPart);
+                }
+                // the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+    return result;
+}
+
+internal void platform_unmap_file(platform_file_view *view)
+{
+    if (view->content)
+    {
+        UnmapViewOfFile(view->content);
+    }
+    *view = {};
+}
+
 #elif __linux__
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <x86intrin.h>
 
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif  // MAP_ANONYMOUS
 
+internal uint64_t platform_read_os_clock_ns()
+{
+    // raw is not slewed by ntp, so it's the same clock the tsc ticks against
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL +
+            static_cast<uint64_t>(now.tv_nsec);
+}
+
 internal void* platform_alloc_zeroed(void *base_addr, size_t length)
 {
+#if HANDMADE_ALLOC_CHECK
+    alloc_check_record(alloc_check_source_platform, length);
+#endif  // HANDMADE_ALLOC_CHECK
     void *memory = mmap(base_addr,
                         length,
                         PROT_READ | PROT_WRITE,
@@ -106,177 +377,2672 @@ internal void platform_free(void *memory, size_t length)
     munmap(memory, length);
 }
 
-#if __clang__
-internal __inline__ uint64_t __rdtsc(void)
+internal platform_file_view platform_map_file(const char *filename,
+                                              bool32 prefetch)
+{
+    platform_file_view result {};
+    int fd = open(filename, O_RDONLY);
+    if (fd != -1)
+    {
+        struct stat file_stat {};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+        {
+            size_t size = static_cast<size_t>(file_stat.st_size);
+            void *content = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (content != MAP_FAILED)
+            {
+                if (prefetch)
+                {
+                    madvise(content, size, MADV_WILLNEED);
+                }
+                result.content = content;
+                result.size = size;
+            }
+            else
+            {
+                perror("mmap");
+            }
+        }
+        // the mapping stays valid after close
+        close(fd);
+    }
+    else
+    {
+        perror(filename);
+    }
+    return result;
+}
+
+internal void platform_unmap_file(platform_file_view *view)
+{
+    if (view->content)
+    {
+        munmap(const_cast<void*>(view->content),
+               static_cast<size_t>(view->size));
+    }
+    *view = {};
+}
+
+#endif  // platform check
+
+#include <SDL.h>
+
+// constants
+constexpr const char *kSdlControllerMappingFile = "./data/gamecontrollerdb.hcdb";
+constexpr real32 kSdlControllerMaxStickVal = 32767.0f;
+// constexpr real32 kSdlControllerMinStickVal = -32768;
+
+internal real32 sdl_get_controller_stick_normalized_deadzone(
+    real32 unnormalized_deadzone)
+{
+    return unnormalized_deadzone / std::sqrt(
+        kSdlControllerMaxStickVal * kSdlControllerMaxStickVal * 2.0f);
+}
+
+struct sdl_offscreen_buffer
+{
+    SDL_Texture *texture;
+    int32_t width;
+    int32_t height;
+    ptrdiff_t pitch;
+    void *memory;
+};
+
+struct sdl_sound_ring_buffer
+{
+    size_t size;
+    volatile size_t play_cursor;
+    void *memory;
+};
+
+struct sdl_sound_output
+{
+    sdl_sound_ring_buffer ring_buffer;
+    uint32_t running_sample_index;
+    uint32_t num_sound_ch;
+    uint32_t samples_per_sec;
+    uint32_t sec_to_buffer;
+    SDL_AudioFormat sdl_audio_format;
+    uint32_t sdl_audio_buffer_size_in_samples;
+
+    // calculated values
+    uint32_t latency_sample_count;  // to minimize delay when we want to change the sound
+    uint32_t bytes_per_sample;
+    uint32_t sdl_audio_buffer_size_in_bytes;
+};
+
+// what the game updates at, from the display refresh rate
+struct sdl_display_timing
+{
+    uint32_t refresh_hz;
+    uint32_t game_update_hz;
+    // the display shows each game frame this many times
+    uint32_t vblanks_per_frame;
+    uint64_t vblank_ns;
+    real32 dt_for_frame;
+    uint64_t late_frame_count;
+    uint64_t missed_vblank_count;
+};
+
+// one slot per game_input controller after the keyboard; a pad keeps its
+// slot while it's plugged in, and gets it back when plugged in again if
+// nothing took it meanwhile
+struct sdl_game_controllers
+{
+    SDL_GameController *controllers[game_input::max_controller_count - 1];
+    SDL_Haptic *haptics[game_input::max_controller_count - 1];
+    // removal events only carry this
+    SDL_JoystickID instance_ids[game_input::max_controller_count - 1];
+    // of the last pad in the slot, to give it back the same one
+    SDL_JoystickGUID guids[game_input::max_controller_count - 1];
+    bool32 has_guid[game_input::max_controller_count - 1];
+    // normalized, for the axis values input events carry
+    real32 left_stick_deadzone;
+    real32 right_stick_deadzone;
+    // last raw SDL value per game_input_axis, so an axis event is only sent
+    // when the value the game sees changes, not for every twitch inside the
+    // deadzone
+    int16_t axis_raw_values[game_input::max_controller_count - 1][4];
+    // packed gamecontrollerdb, see handmade_controller_db.h; null content if
+    // it didn't load, pads then only get SDL's built in mappings
+    platform_file_view mapping_db;
+};
+
+// globals
+global_variable bool32 g_running = false;
+global_variable timer_info g_timer {};
+global_variable sdl_offscreen_buffer g_backbuffer {};
+global_variable sdl_display_timing g_display_timing {};
+
+
+internal void sdl_log_error(const char* func_name)
+{
+    printf("%s failed: %s\n", func_name, SDL_GetError());
+}
+
+#if HANDMADE_ALLOC_CHECK
+
+global_variable SDL_malloc_func g_sdl_real_malloc = nullptr;
+global_variable SDL_calloc_func g_sdl_real_calloc = nullptr;
+global_variable SDL_realloc_func g_sdl_real_realloc = nullptr;
+global_variable SDL_free_func g_sdl_real_free = nullptr;
+
+internal void *sdl_alloc_check_malloc(size_t size)
+{
+    alloc_check_record(alloc_check_source_sdl, size);
+    alloc_check_scope scope;
+    return g_sdl_real_malloc(size);
+}
+
+internal void *sdl_alloc_check_calloc(size_t count, size_t size)
+{
+    alloc_check_record(alloc_check_source_sdl, count * size);
+    alloc_check_scope scope;
+    return g_sdl_real_calloc(count, size);
+}
+
+internal void *sdl_alloc_check_realloc(void *ptr, size_t size)
+{
+    alloc_check_record(alloc_check_source_sdl, size);
+    alloc_check_scope scope;
+    return g_sdl_real_realloc(ptr, size);
+}
+
+internal void sdl_alloc_check_install_memory_functions()
+{
+    // must be called before SDL_Init, SDL can't free memory with a different
+    // allocator than the one that allocated it
+#if SDL_VERSION_ATLEAST(2, 0, 7)
+    SDL_GetMemoryFunctions(&g_sdl_real_malloc, &g_sdl_real_calloc,
+                           &g_sdl_real_realloc, &g_sdl_real_free);
+    if (SDL_SetMemoryFunctions(sdl_alloc_check_malloc, sdl_alloc_check_calloc,
+                               sdl_alloc_check_realloc, g_sdl_real_free) != 0)
+    {
+        sdl_log_error("SDL_SetMemoryFunctions");
+    }
+#else
+    printf("SDL older than 2.0.7, SDL_malloc only counted as malloc\n");
+#endif  // SDL_VERSION_ATLEAST
+}
+
+#endif  // HANDMADE_ALLOC_CHECK
+
+#if HANDMADE_INTERNAL_BUILD
+
+// for debugging only, so just ansi filenames
+internal debug_read_file_result debug_platform_read_entire_file(
+    const char *filename)
 {
-    unsigned hi, lo;
-    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
-    return ( (uint64_t)lo)|( ((uint64_t)hi)<<32 );
+    // open file
+    // get file size
+    // alloc buffer
+    // read entire file
+    // close file
+    debug_read_file_result result {};
+    SDL_RWops *file = SDL_RWFromFile(filename, "rb");
+    if (file)
+    {
+        int64_t filesize = SDL_RWsize(file);
+        if (filesize >= 0)
+        {
+            result.size = safe_truncate_int64_uint32(filesize);
+            result.content = platform_alloc_zeroed(nullptr, result.size);
+            if (result.content)
+            {
+                if (1 == SDL_RWread(file, result.content, result.size, 1))
+                {
+                    // NOTE: file read successfully
+                }
+                else
+                {
+                    sdl_log_error("SDL_RWread");
+                    debug_platform_free_file_memory(&result);
+                }
+            }
+            else
+            {
+                // TODO: logging
+            }
+        }
+        else
+        {
+            // TODO: logging
+            sdl_log_error("SDL_RWops");
+        }
+        if (0 != SDL_RWclose(file))
+        {
+            sdl_log_error("SDL_RWclose");
+        }
+    }
+    else
+    {
+        // TODO: logging
+        sdl_log_error("SDL_RWFromFile");
+    }
+    return result;
+}
+
+internal void debug_platform_free_file_memory(debug_read_file_result *file_mem)
+{
+    platform_free(file_mem->content, file_mem->size);
+    file_mem->content = nullptr;
+    file_mem->size = 0;
+}
+
+internal bool32 debug_platform_write_entire_file(const char *filename,
+                                                 void *memory,
+                                                 uint32_t mem_size)
+{
+    // open file
+    // write entire file
+    // close file
+    bool32 result = false;
+    SDL_RWops *file = SDL_RWFromFile(filename, "wb");
+    if (file)
+    {
+        if (SDL_RWwrite(file, memory, mem_size, 1) == 1)
+        {
+            result = true;
+        }
+        else
+        {
+            // TODO: logging
+            sdl_log_error("SDL_RWwrite");
+        }
+        if (0 != SDL_RWclose(file))
+        {
+            sdl_log_error("SDL_RWclose");
+        }
+    }
+    else
+    {
+        // TODO: logging
+        sdl_log_error("SDL_RWFromFile");
+    }
+
+    return result;
+}
+
+/*
+  Game memory snapshot.
+
+  Permanent storage is mirrored by a file mapped MAP_SHARED. Transient
+  storage is left out: it holds the asset cache, whose slots are owned by the
+  loader thread while loads are in flight and which points into the asset
+  pack mapping of the process that made it, so it can't be restored. Writes
+  to game memory are tracked per page with mprotect: after every snapshot or
+  restore the block is made read only, and the first write to a page faults
+  into sdl_snapshot_segv_handler which marks the page dirty and makes it
+  writable again. Snapshot and restore then only copy the dirty pages, so
+  their cost is proportional to what the game touched since the last one,
+  not to the size of game memory.
+
+  NOTE: a syscall (eg. read()) writing into a protected page fails with EFAULT
+  instead of faulting, so platform services must not write into game memory
+  directly.
+*/
+struct sdl_game_memory_snapshot
+{
+    int fd;
+    uint8_t *game_memory;
+    uint8_t *snapshot_memory;
+    uint64_t size;
+    size_t page_size;
+    size_t num_pages;
+    // one byte per page, written by the signal handler
+    volatile uint8_t *dirty_pages;
+};
+
+global_variable sdl_game_memory_snapshot g_snapshot {};
+
+#if __linux__
+
+#include <signal.h>
+
+constexpr const char *kSdlSnapshotFile = "handmade_snapshot.hms";
+
+global_variable struct sigaction g_prev_segv_action {};
+
+internal void sdl_snapshot_segv_handler(int, siginfo_t *info, void *)
+{
+    uint8_t *addr = static_cast<uint8_t*>(info->si_addr);
+    if (g_snapshot.game_memory &&
+        addr >= g_snapshot.game_memory &&
+        addr < g_snapshot.game_memory + g_snapshot.size)
+    {
+        size_t page_index = static_cast<size_t>(addr - g_snapshot.game_memory) /
+                g_snapshot.page_size;
+        g_snapshot.dirty_pages[page_index] = 1;
+        mprotect(g_snapshot.game_memory + page_index * g_snapshot.page_size,
+                 g_snapshot.page_size, PROT_READ | PROT_WRITE);
+        return;
+    }
+    // not ours, restore the previous handler and let the access fault again
+    sigaction(SIGSEGV, &g_prev_segv_action, nullptr);
+}
+
+internal bool32 sdl_init_game_memory_snapshot(sdl_game_memory_snapshot *snapshot,
+                                              void *game_memory, uint64_t size,
+                                              bool32 keep_existing)
+{
+    bool32 succeeded = false;
+    snapshot->page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    snapshot->num_pages = (size + snapshot->page_size - 1) / snapshot->page_size;
+    snapshot->size = snapshot->num_pages * snapshot->page_size;
+
+    // truncate so the file starts out zeroed, same as the fresh game memory,
+    // unless we want to restore the state saved by a previous run
+    int flags = O_RDWR | O_CREAT | (keep_existing ? 0 : O_TRUNC);
+    snapshot->fd = open(kSdlSnapshotFile, flags, 0644);
+    if (snapshot->fd == -1)
+    {
+        perror("open snapshot file");
+        return succeeded;
+    }
+    if (ftruncate(snapshot->fd, static_cast<off_t>(snapshot->size)) != 0)
+    {
+        perror("ftruncate snapshot file");
+        close(snapshot->fd);
+        return succeeded;
+    }
+    void *mapped = mmap(nullptr, snapshot->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, snapshot->fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        perror("mmap snapshot file");
+        close(snapshot->fd);
+        return succeeded;
+    }
+    snapshot->snapshot_memory = static_cast<uint8_t*>(mapped);
+    snapshot->dirty_pages = static_cast<uint8_t*>(
+        platform_alloc_zeroed(nullptr, snapshot->num_pages));
+
+    struct sigaction action {};
+    action.sa_sigaction = sdl_snapshot_segv_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &g_prev_segv_action);
+
+    // game memory and a fresh snapshot are both zero, so every page starts
+    // clean; for a kept snapshot only the parts of the (sparse) file that
+    // hold data differ from game memory
+    if (keep_existing)
+    {
+        off_t file_size = static_cast<off_t>(snapshot->size);
+        off_t data = lseek(snapshot->fd, 0, SEEK_DATA);
+        while (data >= 0 && data < file_size)
+        {
+            off_t hole = lseek(snapshot->fd, data, SEEK_HOLE);
+            if (hole < 0)
+            {
+                hole = file_size;
+            }
+            for (size_t page_index = static_cast<size_t>(data) /
+                         snapshot->page_size;
+                 page_index * snapshot->page_size < static_cast<size_t>(hole);
+                 ++page_index)
+            {
+                snapshot->dirty_pages[page_index] = 1;
+            }
+            data = lseek(snapshot->fd, hole, SEEK_DATA);
+        }
+    }
+    snapshot->game_memory = static_cast<uint8_t*>(game_memory);
+    mprotect(snapshot->game_memory, snapshot->size, PROT_READ);
+    succeeded = true;
+    return succeeded;
+}
+
+internal void sdl_free_game_memory_snapshot(sdl_game_memory_snapshot *snapshot)
+{
+    if (!snapshot->game_memory)
+    {
+        return;
+    }
+    mprotect(snapshot->game_memory, snapshot->size, PROT_READ | PROT_WRITE);
+    sigaction(SIGSEGV, &g_prev_segv_action, nullptr);
+    munmap(snapshot->snapshot_memory, snapshot->size);
+    close(snapshot->fd);
+    platform_free(const_cast<uint8_t*>(snapshot->dirty_pages),
+                  snapshot->num_pages);
+    *snapshot = {};
+}
+
+// copies every run of dirty pages between game memory and the snapshot and
+// marks it clean again; returns the number of pages copied. Each run is
+// marked clean and write protected before it's copied, so a write from
+// another thread either lands before the copy and goes with it, or faults and
+// marks the page dirty again for the next sync.
+internal size_t sdl_sync_game_memory_snapshot(sdl_game_memory_snapshot *snapshot,
+                                              bool32 to_snapshot)
+{
+    size_t num_copied = 0;
+    size_t page_index = 0;
+    while (page_index < snapshot->num_pages)
+    {
+        if (!snapshot->dirty_pages[page_index])
+        {
+            ++page_index;
+            continue;
+        }
+        size_t run_begin = page_index;
+        while (page_index < snapshot->num_pages &&
+               snapshot->dirty_pages[page_index])
+        {
+            ++page_index;
+        }
+        size_t offset = run_begin * snapshot->page_size;
+        size_t length = (page_index - run_begin) * snapshot->page_size;
+        std::memset(const_cast<uint8_t*>(snapshot->dirty_pages) + run_begin, 0,
+                    page_index - run_begin);
+        if (to_snapshot)
+        {
+            mprotect(snapshot->game_memory + offset, length, PROT_READ);
+            std::memcpy(snapshot->snapshot_memory + offset,
+                        snapshot->game_memory + offset, length);
+        }
+        else
+        {
+            // pages marked at init haven't been written yet, so they are
+            // still protected
+            mprotect(snapshot->game_memory + offset, length,
+                     PROT_READ | PROT_WRITE);
+            std::memcpy(snapshot->game_memory + offset,
+                        snapshot->snapshot_memory + offset, length);
+            mprotect(snapshot->game_memory + offset, length, PROT_READ);
+        }
+        num_copied += page_index - run_begin;
+    }
+    // clean pages were never made writable, so nothing else to protect
+    return num_copied;
+}
+
+#else  // __linux__
+
+internal bool32 sdl_init_game_memory_snapshot(sdl_game_memory_snapshot *,
+                                              void *, uint64_t, bool32)
+{
+    printf("Game memory snapshot not supported on this platform\n");
+    return false;
+}
+
+internal void sdl_free_game_memory_snapshot(sdl_game_memory_snapshot *)
+{
+}
+
+internal size_t sdl_sync_game_memory_snapshot(sdl_game_memory_snapshot *,
+                                              bool32)
+{
+    return 0;
+}
+
+#endif  // __linux__
+
+internal void sdl_take_game_memory_snapshot(sdl_game_memory_snapshot *snapshot)
+{
+    if (!snapshot->game_memory)
+    {
+        return;
+    }
+    uint64_t start = read_timer(&g_timer);
+    size_t num_pages = sdl_sync_game_memory_snapshot(snapshot, true);
+    real32 ms = ticks_to_ms(&g_timer, read_timer(&g_timer) - start);
+    printf("Snapshot: %" PRIuS " pages in %.3f ms\n", num_pages, ms);
+}
+
+internal void sdl_restore_game_memory_snapshot(
+    sdl_game_memory_snapshot *snapshot)
+{
+    if (!snapshot->game_memory)
+    {
+        return;
+    }
+    uint64_t start = read_timer(&g_timer);
+    size_t num_pages = sdl_sync_game_memory_snapshot(snapshot, false);
+    real32 ms = ticks_to_ms(&g_timer, read_timer(&g_timer) - start);
+    printf("Restore: %" PRIuS " pages in %.3f ms\n", num_pages, ms);
+}
+
+#endif // HANDMADE_INTERNAL_BUILD
+
+/*
+  Input recording and playback.
+
+  The game_input fed to game_update_and_render is written to a file each
+  frame, so a session can be replayed frame by frame without anyone at the
+  controls. To keep the file small, controllers are stored packed
+  (game_packed_controller) and a frame only stores the ones that changed
+  since the previous frame: a byte with one bit per controller, followed by
+  the changed packed controllers. Button transitions aren't stored, playback
+  works them out from consecutive frames.
+
+  The header keeps the game update rate the recording was made at, so
+  playback hands the game the same dt_for_frame whatever the display. With a
+  fixed timestep a frame in the file is one simulation step.
+
+  In internal builds recording starts from a game memory snapshot, and
+  playback restores it first (and on every loop), so the game runs through
+  exactly the same states each time.
+*/
+constexpr const char *kSdlInputRecordingFile = "handmade_input.hmi";
+constexpr uint32_t kSdlInputRecordingMagic = 0x494d4d48;  // "HMMI"
+constexpr uint16_t kSdlInputRecordingVersion = 3;
+
+struct sdl_input_recording_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t controller_size;
+    uint32_t max_controller_count;
+    bool32 from_snapshot;
+    real32 dt_for_frame;
+};
+
+enum sdl_input_recording_mode
+{
+    sdl_input_recording_mode_off,
+    sdl_input_recording_mode_record,
+    sdl_input_recording_mode_playback,
+};
+
+struct sdl_input_recording
+{
+    sdl_input_recording_mode mode;
+    SDL_RWops *file;
+    bool32 loop;
+    bool32 from_snapshot;
+    // what the game is updated with, new recordings keep it
+    real32 game_dt_for_frame;
+    // what the recording being played back was made with
+    real32 playback_dt_for_frame;
+    uint64_t frame_count;
+    // controllers are delta coded against the previous frame
+    game_packed_input last_input;
+};
+
+global_variable sdl_input_recording g_input_recording {};
+
+internal bool32 sdl_begin_input_recording(sdl_input_recording *recording,
+                                          const char *filename)
+{
+    HANDMADE_ASSERT(recording->mode == sdl_input_recording_mode_off);
+    bool32 succeeded = false;
+    recording->file = SDL_RWFromFile(filename, "wb");
+    if (!recording->file)
+    {
+        sdl_log_error("SDL_RWFromFile");
+        return succeeded;
+    }
+    recording->from_snapshot = false;
+#if HANDMADE_INTERNAL_BUILD
+    if (g_snapshot.game_memory)
+    {
+        sdl_take_game_memory_snapshot(&g_snapshot);
+        recording->from_snapshot = true;
+    }
+#endif // HANDMADE_INTERNAL_BUILD
+
+    sdl_input_recording_header header {};
+    header.magic = kSdlInputRecordingMagic;
+    header.version = kSdlInputRecordingVersion;
+    header.controller_size = sizeof(game_packed_controller);
+    header.max_controller_count = game_input::max_controller_count;
+    header.from_snapshot = recording->from_snapshot;
+    header.dt_for_frame = recording->game_dt_for_frame;
+    if (SDL_RWwrite(recording->file, &header, sizeof(header), 1) != 1)
+    {
+        sdl_log_error("SDL_RWwrite");
+        SDL_RWclose(recording->file);
+        recording->file = nullptr;
+        return succeeded;
+    }
+    recording->mode = sdl_input_recording_mode_record;
+    recording->frame_count = 0;
+    recording->last_input = {};
+    printf("Recording input to %s\n", filename);
+    succeeded = true;
+    return succeeded;
+}
+
+internal void sdl_end_input_recording(sdl_input_recording *recording)
+{
+    HANDMADE_ASSERT(recording->mode != sdl_input_recording_mode_off);
+    if (0 != SDL_RWclose(recording->file))
+    {
+        sdl_log_error("SDL_RWclose");
+    }
+    printf("%s input stopped after %" PRIu64 " frames\n",
+           recording->mode == sdl_input_recording_mode_record ?
+           "Recording" : "Playback",
+           recording->frame_count);
+    recording->file = nullptr;
+    recording->mode = sdl_input_recording_mode_off;
+}
+
+internal void sdl_record_input(sdl_input_recording *recording,
+                               const game_input *input)
+{
+    static_assert(game_input::max_controller_count <= 8,
+                  "changed controller mask must fit in a byte");
+    game_packed_input packed;
+    pack_input(&packed, input);
+    uint8_t changed_mask = 0;
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        if (std::memcmp(&packed.controllers[controller_index],
+                        &recording->last_input.controllers[controller_index],
+                        sizeof(game_packed_controller)) != 0)
+        {
+            changed_mask |= static_cast<uint8_t>(1 << controller_index);
+        }
+    }
+
+    SDL_RWwrite(recording->file, &changed_mask, sizeof(changed_mask), 1);
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        if (changed_mask & (1 << controller_index))
+        {
+            SDL_RWwrite(recording->file, &packed.controllers[controller_index],
+                        sizeof(game_packed_controller), 1);
+        }
+    }
+    recording->last_input = packed;
+    ++recording->frame_count;
+}
+
+// rewinds to the first frame, and to the recorded starting state if any
+internal bool32 sdl_rewind_input_playback(sdl_input_recording *recording)
+{
+    bool32 succeeded = false;
+    if (SDL_RWseek(recording->file, sizeof(sdl_input_recording_header),
+                   RW_SEEK_SET) < 0)
+    {
+        sdl_log_error("SDL_RWseek");
+        return succeeded;
+    }
+#if HANDMADE_INTERNAL_BUILD
+    if (recording->from_snapshot)
+    {
+        sdl_restore_game_memory_snapshot(&g_snapshot);
+    }
+#endif // HANDMADE_INTERNAL_BUILD
+    recording->last_input = {};
+    succeeded = true;
+    return succeeded;
+}
+
+internal bool32 sdl_begin_input_playback(sdl_input_recording *recording,
+                                         const char *filename, bool32 loop)
+{
+    HANDMADE_ASSERT(recording->mode == sdl_input_recording_mode_off);
+    bool32 succeeded = false;
+    recording->file = SDL_RWFromFile(filename, "rb");
+    if (!recording->file)
+    {
+        sdl_log_error("SDL_RWFromFile");
+        return succeeded;
+    }
+    sdl_input_recording_header header {};
+    if (SDL_RWread(recording->file, &header, sizeof(header), 1) != 1 ||
+        header.magic != kSdlInputRecordingMagic ||
+        header.version != kSdlInputRecordingVersion ||
+        header.controller_size != sizeof(game_packed_controller) ||
+        header.max_controller_count != game_input::max_controller_count)
+    {
+        printf("%s is not a compatible input recording\n", filename);
+        SDL_RWclose(recording->file);
+        recording->file = nullptr;
+        return succeeded;
+    }
+    recording->from_snapshot = header.from_snapshot;
+    recording->playback_dt_for_frame = header.dt_for_frame;
+#if HANDMADE_INTERNAL_BUILD
+    if (recording->from_snapshot && !g_snapshot.game_memory)
+    {
+        printf("No game memory snapshot, playing back from current state\n");
+        recording->from_snapshot = false;
+    }
+#else
+    recording->from_snapshot = false;
+#endif // HANDMADE_INTERNAL_BUILD
+    if (!sdl_rewind_input_playback(recording))
+    {
+        SDL_RWclose(recording->file);
+        recording->file = nullptr;
+        return succeeded;
+    }
+    recording->mode = sdl_input_recording_mode_playback;
+    recording->loop = loop;
+    recording->frame_count = 0;
+    printf("Playing back input from %s%s\n", filename, loop ? " (loop)" : "");
+    succeeded = true;
+    return succeeded;
+}
+
+// the next frame on top of the previous one; false at the end of the file,
+// and for a frame cut short, which is treated the same
+internal bool32 sdl_read_recorded_frame(sdl_input_recording *recording,
+                                        game_packed_input *frame)
+{
+    uint8_t changed_mask = 0;
+    if (SDL_RWread(recording->file, &changed_mask, sizeof(changed_mask), 1) != 1)
+    {
+        return false;
+    }
+    *frame = recording->last_input;
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        if ((changed_mask & (1 << controller_index)) &&
+            SDL_RWread(recording->file, &frame->controllers[controller_index],
+                       sizeof(game_packed_controller), 1) != 1)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// returns false once a non-looping playback runs out of frames
+internal bool32 sdl_playback_input(sdl_input_recording *recording,
+                                   game_input *input)
+{
+    game_packed_input frame;
+    if (!sdl_read_recorded_frame(recording, &frame))
+    {
+        if (!recording->loop || !sdl_rewind_input_playback(recording) ||
+            !sdl_read_recorded_frame(recording, &frame))
+        {
+            sdl_end_input_recording(recording);
+            return false;
+        }
+    }
+    game_packed_input prev = recording->last_input;
+    recording->last_input = frame;
+    unpack_input(input, &recording->last_input, &prev);
+    input->dt_for_frame = recording->playback_dt_for_frame;
+    // nobody's at the controls, so no latency to measure, and the recording
+    // has no event timing
+    input->sample_counter = 0;
+    clear_input_events(input);
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        input->change_counters[controller_index] = 0;
+    }
+    ++recording->frame_count;
+    return true;
+}
+
+// L starts recording, pressing it again plays the recording back in a loop,
+// and a third time stops playback
+internal void sdl_toggle_input_recording(sdl_input_recording *recording)
+{
+    switch (recording->mode)
+    {
+    case sdl_input_recording_mode_off:
+        {
+            sdl_begin_input_recording(recording, kSdlInputRecordingFile);
+        }
+        break;
+    case sdl_input_recording_mode_record:
+        {
+            sdl_end_input_recording(recording);
+            sdl_begin_input_playback(recording, kSdlInputRecordingFile, true);
+        }
+        break;
+    case sdl_input_recording_mode_playback:
+        {
+            sdl_end_input_recording(recording);
+        }
+        break;
+    }
+}
+
+/*
+  CPU topology and thread placement.
+
+  Logical cpus are grouped into physical cores (SMT siblings), packages and
+  NUMA nodes. Only cpus the process may run on count, so taskset and cgroup
+  limits are respected. A policy then picks the cpu for the main, audio,
+  loader and worker threads, and each thread pins itself when it starts.
+*/
+constexpr uint32_t kSdlMaxCpus = 256;
+// worker threads plus the game thread
+constexpr uint32_t kSdlMaxWorkThreads = 64;
+
+struct sdl_logical_cpu
+{
+    int32_t os_index;
+    int32_t package_id;
+    int32_t core_id;  // only unique within a package
+    int32_t node_id;
+    uint32_t core_index;  // unique across packages
+    uint32_t smt_index;   // 0 for the first thread of a core
+};
+
+struct sdl_cpu_topology
+{
+    uint32_t cpu_count;
+    uint32_t core_count;
+    uint32_t package_count;
+    uint32_t node_count;
+    // sorted by node, package, core, then smt index
+    sdl_logical_cpu cpus[kSdlMaxCpus];
+};
+
+enum sdl_affinity_policy : uint32_t
+{
+    sdl_affinity_policy_none,      // leave it all to the os
+    sdl_affinity_policy_physical,  // a thread per physical core
+    sdl_affinity_policy_logical,   // a thread per logical cpu
+};
+
+global_variable const char *kSdlAffinityPolicyNames[] =
+{
+    "none",
+    "physical",
+    "logical",
+};
+
+struct sdl_thread_layout
+{
+    sdl_affinity_policy policy;
+    // -1 leaves a thread unpinned
+    int32_t main_cpu;
+    // audio and loader mostly sleep, so they share the main core's sibling
+    int32_t helper_cpu;
+    uint32_t worker_count;
+    int32_t worker_cpus[kSdlMaxWorkThreads - 1];
+};
+
+global_variable sdl_cpu_topology g_cpu_topology {};
+global_variable sdl_thread_layout g_thread_layout {};
+
+internal bool sdl_logical_cpu_less(const sdl_logical_cpu &a,
+                                   const sdl_logical_cpu &b)
+{
+    if (a.node_id != b.node_id)
+    {
+        return a.node_id < b.node_id;
+    }
+    if (a.package_id != b.package_id)
+    {
+        return a.package_id < b.package_id;
+    }
+    if (a.core_id != b.core_id)
+    {
+        return a.core_id < b.core_id;
+    }
+    return a.os_index < b.os_index;
+}
+
+// numbers cores, siblings, packages and nodes once every cpu is added
+internal void sdl_finish_cpu_topology(sdl_cpu_topology *topology)
+{
+    std::sort(topology->cpus, topology->cpus + topology->cpu_count,
+              sdl_logical_cpu_less);
+    topology->core_count = 0;
+    topology->package_count = 0;
+    topology->node_count = 0;
+    for (uint32_t cpu_index = 0; cpu_index < topology->cpu_count; ++cpu_index)
+    {
+        sdl_logical_cpu *cpu = &topology->cpus[cpu_index];
+        const sdl_logical_cpu *prev =
+                cpu_index ? &topology->cpus[cpu_index - 1] : nullptr;
+        bool32 new_node = !prev || prev->node_id != cpu->node_id;
+        bool32 new_package = new_node || prev->package_id != cpu->package_id;
+        bool32 new_core = new_package || prev->core_id != cpu->core_id;
+        topology->node_count += new_node ? 1 : 0;
+        // a package split over nodes is counted once per node
+        topology->package_count += new_package ? 1 : 0;
+        if (new_core)
+        {
+            cpu->core_index = topology->core_count++;
+            cpu->smt_index = 0;
+        }
+        else
+        {
+            cpu->core_index = prev->core_index;
+            cpu->smt_index = prev->smt_index + 1;
+        }
+    }
+}
+
+#if __linux__
+
+#include <sched.h>
+
+// what the process may run on, for threads left unpinned; threads start out
+// with their creator's mask, so they have to be given this back explicitly
+global_variable cpu_set_t g_process_cpus;
+
+internal int32_t sdl_read_sysfs_int(const char *path, int32_t default_value)
+{
+    int32_t result = default_value;
+    FILE *file = fopen(path, "r");
+    if (file)
+    {
+        if (fscanf(file, "%d", &result) != 1)
+        {
+            result = default_value;
+        }
+        fclose(file);
+    }
+    return result;
+}
+
+// sets node_id on every cpu in a sysfs cpu list such as "0-3,8,10-11"
+internal void sdl_apply_node_cpu_list(sdl_cpu_topology *topology,
+                                      const char *list, int32_t node_id)
+{
+    const char *at = list;
+    while (*at >= '0' && *at <= '9')
+    {
+        char *end = nullptr;
+        long first = std::strtol(at, &end, 10);
+        long last = first;
+        if (*end == '-')
+        {
+            last = std::strtol(end + 1, &end, 10);
+        }
+        for (uint32_t cpu_index = 0;
+             cpu_index < topology->cpu_count;
+             ++cpu_index)
+        {
+            sdl_logical_cpu *cpu = &topology->cpus[cpu_index];
+            if (cpu->os_index >= first && cpu->os_index <= last)
+            {
+                cpu->node_id = node_id;
+            }
+        }
+        at = *end == ',' ? end + 1 : end;
+    }
+}
+
+internal void sdl_read_cpu_topology(sdl_cpu_topology *topology)
+{
+    *topology = {};
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        // TODO: logging
+        for (int32_t os_index = 0; os_index < SDL_GetCPUCount(); ++os_index)
+        {
+            CPU_SET(static_cast<size_t>(os_index), &allowed);
+        }
+    }
+    g_process_cpus = allowed;
+    char path[128];
+    for (int32_t os_index = 0;
+         os_index < CPU_SETSIZE && topology->cpu_count < kSdlMaxCpus;
+         ++os_index)
+    {
+        if (!CPU_ISSET(static_cast<size_t>(os_index), &allowed))
+        {
+            continue;
+        }
+        sdl_logical_cpu *cpu = &topology->cpus[topology->cpu_count++];
+        cpu->os_index = os_index;
+        // without sysfs every cpu looks like its own core
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+                 os_index);
+        cpu->package_id = sdl_read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/topology/core_id", os_index);
+        cpu->core_id = sdl_read_sysfs_int(path, os_index);
+    }
+    // node ids can have gaps
+    char list[1024];
+    for (int32_t node_id = 0; node_id < 256; ++node_id)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+                 node_id);
+        FILE *file = fopen(path, "r");
+        if (file)
+        {
+            if (fgets(list, sizeof(list), file))
+            {
+                sdl_apply_node_cpu_list(topology, list, node_id);
+            }
+            fclose(file);
+        }
+    }
+    sdl_finish_cpu_topology(topology);
+}
+
+// -1 unpins, back to every cpu the process was allowed at startup
+internal bool32 sdl_pin_current_thread(int32_t os_index)
+{
+    bool32 succeeded = false;
+    cpu_set_t set = g_process_cpus;
+    if (os_index >= 0)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<size_t>(os_index), &set);
+    }
+    // pid 0 is the calling thread, not the whole process
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+    {
+        printf("sched_setaffinity failed for cpu %d\n", os_index);
+        return succeeded;
+    }
+    succeeded = true;
+    return succeeded;
+}
+
+#else  // __linux__
+
+// TODO: GetLogicalProcessorInformationEx and SetThreadAffinityMask on win32
+internal void sdl_read_cpu_topology(sdl_cpu_topology *topology)
+{
+    *topology = {};
+    int32_t cpu_count = std::min(SDL_GetCPUCount(),
+                                 static_cast<int32_t>(kSdlMaxCpus));
+    for (int32_t os_index = 0; os_index < cpu_count; ++os_index)
+    {
+        sdl_logical_cpu *cpu = &topology->cpus[topology->cpu_count++];
+        cpu->os_index = os_index;
+        cpu->core_id = os_index;
+    }
+    sdl_finish_cpu_topology(topology);
+}
+
+internal bool32 sdl_pin_current_thread(int32_t)
+{
+    return false;
+}
+
+#endif  // __linux__
+
+internal void sdl_plan_thread_layout(const sdl_cpu_topology *topology,
+                                     sdl_affinity_policy policy,
+                                     sdl_thread_layout *layout)
+{
+    *layout = {};
+    layout->policy = policy;
+    layout->main_cpu = -1;
+    layout->helper_cpu = -1;
+    uint32_t max_worker_count = kSdlMaxWorkThreads - 1;
+    if (policy == sdl_affinity_policy_none || topology->cpu_count == 0)
+    {
+        layout->policy = sdl_affinity_policy_none;
+        layout->worker_count = std::min(
+            topology->cpu_count ? topology->cpu_count - 1 : 0,
+            max_worker_count);
+        for (uint32_t worker_index = 0;
+             worker_index < layout->worker_count;
+             ++worker_index)
+        {
+            layout->worker_cpus[worker_index] = -1;
+        }
+        return;
+    }
+
+    // the main thread takes the first core of the first node, so workers
+    // fill up its node before spilling onto the next one
+    const sdl_logical_cpu *main_cpu = &topology->cpus[0];
+    layout->main_cpu = main_cpu->os_index;
+    uint32_t max_smt_index = 0;
+    for (uint32_t cpu_index = 0; cpu_index < topology->cpu_count; ++cpu_index)
+    {
+        const sdl_logical_cpu *cpu = &topology->cpus[cpu_index];
+        max_smt_index = std::max(max_smt_index, cpu->smt_index);
+        if (cpu->core_index == main_cpu->core_index && cpu->smt_index == 1)
+        {
+            layout->helper_cpu = cpu->os_index;
+        }
+    }
+    if (policy == sdl_affinity_policy_physical)
+    {
+        max_smt_index = 0;
+    }
+    else
+    {
+        // every logical cpu runs a worker, audio and loader float
+        layout->helper_cpu = -1;
+    }
+    // first threads of every core before any second threads
+    for (uint32_t smt_index = 0; smt_index <= max_smt_index; ++smt_index)
+    {
+        for (uint32_t cpu_index = 0;
+             cpu_index < topology->cpu_count &&
+             layout->worker_count < max_worker_count;
+             ++cpu_index)
+        {
+            const sdl_logical_cpu *cpu = &topology->cpus[cpu_index];
+            if (cpu->smt_index == smt_index && cpu != main_cpu)
+            {
+                layout->worker_cpus[layout->worker_count++] = cpu->os_index;
+            }
+        }
+    }
+}
+
+internal void sdl_print_thread_layout(const sdl_cpu_topology *topology,
+                                      const sdl_thread_layout *layout)
+{
+    printf("cpu: %u logical, %u cores, %u packages, %u nodes, affinity %s\n",
+           topology->cpu_count, topology->core_count, topology->package_count,
+           topology->node_count, kSdlAffinityPolicyNames[layout->policy]);
+    if (layout->policy == sdl_affinity_policy_none)
+    {
+        printf("  %u workers, nothing pinned\n", layout->worker_count);
+        return;
+    }
+    printf("  main on cpu %d\n", layout->main_cpu);
+    if (layout->helper_cpu >= 0)
+    {
+        printf("  audio and loader on cpu %d\n", layout->helper_cpu);
+    }
+    else
+    {
+        printf("  audio and loader unpinned\n");
+    }
+    printf("  %u workers on cpus", layout->worker_count);
+    for (uint32_t worker_index = 0;
+         worker_index < layout->worker_count;
+         ++worker_index)
+    {
+        printf(" %d", layout->worker_cpus[worker_index]);
+    }
+    printf("\n");
+}
+
+struct sdl_command_line
+{
+    const char *record_file;
+    const char *playback_file;
+    bool32 loop_playback;
+    uint64_t asset_memory_budget;
+    sdl_affinity_policy affinity_policy;
+    const char *trace_file;
+    uint64_t stats_interval_sec;
+    bool32 perf_counters;
+    // 0 to follow the display
+    uint32_t target_hz;
+    bool32 unthrottled;
+    // 0 for one game update a frame
+    uint32_t fixed_step_hz;
+    bool32 late_stick_sample;
+    bool32 eager_init;
+};
+
+internal void sdl_print_usage(const char *exe_name)
+{
+    printf("Usage: %s [options]\n"
+           "  --record <file>    record input from the first frame\n"
+           "  --playback <file>  play back recorded input, quit when done\n"
+           "  --loop             loop --playback instead of quitting\n"
+           "  --asset-budget <MB>  memory for cached assets (default 256)\n"
+           "  --affinity <none|physical|logical>\n"
+           "                     how threads are pinned to cpus "
+           "(default physical)\n"
+           "  --stats-interval <seconds>\n"
+           "                     print frame time percentiles every interval\n"
+           "  --perf-counters    count cache, branch and TLB misses per frame "
+           "stage (linux)\n"
+           "  --target-hz <hz>   pace frames to this rate instead of the "
+           "display's\n"
+           "  --unthrottled      don't pace frames, run as fast as possible\n"
+           "  --fixed-step-hz <hz>\n"
+           "                     simulate in fixed steps at this rate and "
+           "interpolate frames\n"
+           "  --late-stick-sample  with --fixed-step-hz, read sticks again "
+           "before each\n"
+           "                     catch up step\n"
+           "  --eager-init       bring up audio and controllers before the "
+           "first frame\n",
+           exe_name);
+#if HANDMADE_DIAGNOSTIC
+    printf("  --trace <file>     write profiled blocks as Chrome trace JSON\n");
+#endif  // HANDMADE_DIAGNOSTIC
+}
+
+internal bool32 sdl_parse_command_line(int argc, char **argv,
+                                       sdl_command_line *options)
+{
+    bool32 succeeded = true;
+    for (int arg_index = 1; arg_index < argc && succeeded; ++arg_index)
+    {
+        const char *arg = argv[arg_index];
+        bool32 has_value = arg_index + 1 < argc;
+        if (std::strcmp(arg, "--record") == 0 && has_value)
+        {
+            options->record_file = argv[++arg_index];
+        }
+        else if (std::strcmp(arg, "--playback") == 0 && has_value)
+        {
+            options->playback_file = argv[++arg_index];
+        }
+        else if (std::strcmp(arg, "--loop") == 0)
+        {
+            options->loop_playback = true;
+        }
+        else if (std::strcmp(arg, "--asset-budget") == 0 && has_value)
+        {
+            options->asset_memory_budget = megabyte(
+                std::strtoull(argv[++arg_index], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--affinity") == 0 && has_value)
+        {
+            const char *policy = argv[++arg_index];
+            succeeded = false;
+            for (uint32_t policy_index = 0;
+                 policy_index < array_length(kSdlAffinityPolicyNames);
+                 ++policy_index)
+            {
+                if (std::strcmp(policy,
+                                kSdlAffinityPolicyNames[policy_index]) == 0)
+                {
+                    options->affinity_policy =
+                            static_cast<sdl_affinity_policy>(policy_index);
+                    succeeded = true;
+                }
+            }
+            if (!succeeded)
+            {
+                printf("Unknown affinity policy: %s\n", policy);
+            }
+        }
+        else if (std::strcmp(arg, "--target-hz") == 0 && has_value)
+        {
+            options->target_hz = static_cast<uint32_t>(
+                std::strtoul(argv[++arg_index], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--fixed-step-hz") == 0 && has_value)
+        {
+            options->fixed_step_hz = static_cast<uint32_t>(
+                std::strtoul(argv[++arg_index], nullptr, 10));
+        }
+        else if (std::strcmp(arg, "--late-stick-sample") == 0)
+        {
+            options->late_stick_sample = true;
+        }
+        else if (std::strcmp(arg, "--eager-init") == 0)
+        {
+            options->eager_init = true;
+        }
+        else if (std::strcmp(arg, "--unthrottled") == 0)
+        {
+            options->unthrottled = true;
+        }
+        else if (std::strcmp(arg, "--perf-counters") == 0)
+        {
+            options->perf_counters = true;
+        }
+        else if (std::strcmp(arg, "--stats-interval") == 0 && has_value)
+        {
+            options->stats_interval_sec =
+                    std::strtoull(argv[++arg_index], nullptr, 10);
+        }
+#if HANDMADE_DIAGNOSTIC
+        else if (std::strcmp(arg, "--trace") == 0 && has_value)
+        {
+            options->trace_file = argv[++arg_index];
+        }
+#endif  // HANDMADE_DIAGNOSTIC
+        else
+        {
+            printf("Unknown or incomplete option: %s\n", arg);
+            succeeded = false;
+        }
+    }
+    if (succeeded && options->record_file && options->playback_file)
+    {
+        printf("--record and --playback can't be used together\n");
+        succeeded = false;
+    }
+    if (!succeeded)
+    {
+        sdl_print_usage(argv[0]);
+    }
+    return succeeded;
+}
+
+/*
+  Background loader.
+
+  One loader thread runs load procs in the order they are pushed. Requests go
+  from the game thread to the loader, and completions come back, through
+  single producer / single consumer lock-free rings, so neither side ever
+  blocks on the other. The loader sleeps on a semaphore when it runs out of
+  requests.
+*/
+template<typename T, uint32_t count>
+struct sdl_spsc_ring
+{
+    static_assert((count & (count - 1)) == 0, "count must be a power of 2");
+    T entries[count];
+    // free running, wrapped with & (count - 1) on access
+    std::atomic<uint32_t> read_index;
+    std::atomic<uint32_t> write_index;
+};
+
+// producer side only
+template<typename T, uint32_t count>
+internal bool32 sdl_spsc_push(sdl_spsc_ring<T, count> *ring, const T &entry)
+{
+    uint32_t write_index = ring->write_index.load(std::memory_order_relaxed);
+    if (write_index - ring->read_index.load(std::memory_order_acquire) == count)
+    {
+        return false;
+    }
+    ring->entries[write_index & (count - 1)] = entry;
+    ring->write_index.store(write_index + 1, std::memory_order_release);
+    return true;
+}
+
+// consumer side only
+template<typename T, uint32_t count>
+internal bool32 sdl_spsc_pop(sdl_spsc_ring<T, count> *ring, T *entry)
+{
+    uint32_t read_index = ring->read_index.load(std::memory_order_relaxed);
+    if (read_index == ring->write_index.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    *entry = ring->entries[read_index & (count - 1)];
+    ring->read_index.store(read_index + 1, std::memory_order_release);
+    return true;
+}
+
+constexpr uint32_t kSdlLoadQueueSize = 256;
+
+struct sdl_load_entry
+{
+    platform_load_proc *proc;
+    void *data;
+};
+
+struct sdl_loader
+{
+    SDL_Thread *thread;
+    SDL_sem *semaphore;
+    std::atomic<bool> running;
+    sdl_spsc_ring<sdl_load_entry, kSdlLoadQueueSize> requests;
+    sdl_spsc_ring<void*, kSdlLoadQueueSize> completions;
+};
+
+global_variable sdl_loader g_loader {};
+
+internal int sdl_loader_thread_proc(void *userdata)
+{
+    sdl_loader *loader = static_cast<sdl_loader*>(userdata);
+    sdl_pin_current_thread(g_thread_layout.helper_cpu);
+#if HANDMADE_DIAGNOSTIC
+    profiler_name_thread("loader");
+#endif  // HANDMADE_DIAGNOSTIC
+    while (loader->running.load(std::memory_order_acquire))
+    {
+        sdl_load_entry entry {};
+        while (sdl_spsc_pop(&loader->requests, &entry))
+        {
+            entry.proc(entry.data);
+            // the game drains completions every frame, so this only waits if
+            // it stalls with more than a queue worth of loads finished
+            while (!sdl_spsc_push(&loader->completions, entry.data))
+            {
+                SDL_Delay(1);
+            }
+        }
+        SDL_SemWait(loader->semaphore);
+    }
+    return 0;
+}
+
+internal bool32 sdl_init_loader(sdl_loader *loader)
+{
+    bool32 succeeded = false;
+    loader->semaphore = SDL_CreateSemaphore(0);
+    if (!loader->semaphore)
+    {
+        sdl_log_error("SDL_CreateSemaphore");
+        return succeeded;
+    }
+    loader->running.store(true, std::memory_order_release);
+    loader->thread = SDL_CreateThread(sdl_loader_thread_proc, "loader", loader);
+    if (!loader->thread)
+    {
+        sdl_log_error("SDL_CreateThread");
+        SDL_DestroySemaphore(loader->semaphore);
+        loader->semaphore = nullptr;
+        return succeeded;
+    }
+    succeeded = true;
+    return succeeded;
+}
+
+internal void sdl_shutdown_loader(sdl_loader *loader)
+{
+    if (loader->thread)
+    {
+        loader->running.store(false, std::memory_order_release);
+        SDL_SemPost(loader->semaphore);
+        SDL_WaitThread(loader->thread, nullptr);
+        loader->thread = nullptr;
+    }
+    if (loader->semaphore)
+    {
+        SDL_DestroySemaphore(loader->semaphore);
+        loader->semaphore = nullptr;
+    }
+}
+
+internal bool32 platform_push_load(platform_load_proc *proc, void *data)
+{
+    bool32 result = false;
+    if (!g_loader.thread)
+    {
+        // no loader thread, load synchronously
+        proc(data);
+        result = sdl_spsc_push(&g_loader.completions, data);
+    }
+    else if (sdl_spsc_push(&g_loader.requests, sdl_load_entry {proc, data}))
+    {
+        SDL_SemPost(g_loader.semaphore);
+        result = true;
+    }
+    return result;
+}
+
+internal bool32 platform_pop_completed_load(void **data)
+{
+    return sdl_spsc_pop(&g_loader.completions, data);
+}
+
+/*
+  Job system.
+
+  The game thread plus one worker thread per remaining core each own a
+  work-stealing deque (Chase-Lev). The owner pushes and pops at the bottom,
+  so jobs a job adds run next on the same core while their data is still in
+  cache; idle threads steal the oldest entry from the top of another deque.
+  Entries added by the game thread are only ever spread by stealing. Every
+  added entry posts the semaphore once, which is what idle workers sleep on.
+*/
+constexpr uint32_t kSdlWorkDequeSize = 256;
+
+struct sdl_work_deque
+{
+    // top is where thieves take from, bottom is only written by the owner
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    // a slot is read by a thief before it knows it won the entry, so the
+    // entries are atomics too; the pair is consistent if the steal succeeds
+    std::atomic<platform_work_queue_callback*> callbacks[kSdlWorkDequeSize];
+    std::atomic<void*> data[kSdlWorkDequeSize];
+    // counted by the owner only, read by anyone
+    std::atomic<uint64_t> jobs_executed;
+    std::atomic<uint64_t> jobs_stolen;
+};
+
+struct sdl_work_thread_context
+{
+    platform_work_queue *queue;
+    uint32_t thread_index;
+    int32_t cpu;  // -1 for unpinned
+};
+
+struct platform_work_queue
+{
+    SDL_sem *semaphore;
+    std::atomic<bool> running;
+    // added but not finished yet
+    std::atomic<int64_t> pending;
+    // deques in use, index 0 is the game thread, 0 before init; fixed while
+    // workers run, a worker that failed to start just leaves an empty deque
+    uint32_t thread_count;
+    SDL_Thread *threads[kSdlMaxWorkThreads];
+    sdl_work_thread_context contexts[kSdlMaxWorkThreads];
+    sdl_work_deque deques[kSdlMaxWorkThreads];
+};
+
+global_variable platform_work_queue g_work_queue {};
+// which deque the calling thread owns
+global_variable thread_local uint32_t g_work_thread_index = 0;
+
+// owner only
+internal bool32 sdl_work_deque_push(sdl_work_deque *deque,
+                                    platform_work_queue_callback *callback,
+                                    void *data)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed);
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    if (bottom - top >= kSdlWorkDequeSize)
+    {
+        return false;
+    }
+    uint32_t slot = static_cast<uint32_t>(bottom) & (kSdlWorkDequeSize - 1);
+    deque->callbacks[slot].store(callback, std::memory_order_relaxed);
+    deque->data[slot].store(data, std::memory_order_relaxed);
+    // publishes the entry and whatever its data points at to thieves
+    deque->bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+// owner only, takes the newest entry
+internal bool32 sdl_work_deque_pop(sdl_work_deque *deque,
+                                   platform_work_queue_callback **callback,
+                                   void **data)
+{
+    int64_t bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    // the lowered bottom must be visible to thieves before top is read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = deque->top.load(std::memory_order_relaxed);
+    bool32 result = false;
+    if (top <= bottom)
+    {
+        uint32_t slot = static_cast<uint32_t>(bottom) & (kSdlWorkDequeSize - 1);
+        *callback = deque->callbacks[slot].load(std::memory_order_relaxed);
+        *data = deque->data[slot].load(std::memory_order_relaxed);
+        result = true;
+        if (top == bottom)
+        {
+            // last entry, race the thieves for it
+            result = deque->top.compare_exchange_strong(
+                top, top + 1, std::memory_order_seq_cst,
+                std::memory_order_relaxed);
+            deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return result;
+}
+
+// any thread, takes the oldest entry; false if empty or another thread won
+internal bool32 sdl_work_deque_steal(sdl_work_deque *deque,
+                                     platform_work_queue_callback **callback,
+                                     void **data)
+{
+    int64_t top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = deque->bottom.load(std::memory_order_acquire);
+    bool32 result = false;
+    if (top < bottom)
+    {
+        uint32_t slot = static_cast<uint32_t>(top) & (kSdlWorkDequeSize - 1);
+        *callback = deque->callbacks[slot].load(std::memory_order_relaxed);
+        *data = deque->data[slot].load(std::memory_order_relaxed);
+        result = deque->top.compare_exchange_strong(
+            top, top + 1, std::memory_order_seq_cst,
+            std::memory_order_relaxed);
+    }
+    return result;
+}
+
+// runs one entry, from the thread's own deque if it has any, otherwise
+// stolen; returns false if nothing was found
+internal bool32 sdl_do_next_work_entry(platform_work_queue *queue,
+                                       uint32_t thread_index)
+{
+    sdl_work_deque *own = &queue->deques[thread_index];
+    platform_work_queue_callback *callback = nullptr;
+    void *data = nullptr;
+    bool32 found = sdl_work_deque_pop(own, &callback, &data);
+    if (!found)
+    {
+        // start with the next thread over so thieves spread out
+        for (uint32_t offset = 1;
+             !found && offset < queue->thread_count;
+             ++offset)
+        {
+            uint32_t victim = (thread_index + offset) % queue->thread_count;
+            found = sdl_work_deque_steal(&queue->deques[victim],
+                                         &callback, &data);
+        }
+        if (found)
+        {
+            own->jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (found)
+    {
+        TIMED_BLOCK("work_entry");
+        callback(queue, data);
+        own->jobs_executed.fetch_add(1, std::memory_order_relaxed);
+        // release publishes what the job wrote to whoever sees pending drop
+        queue->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return found;
+}
+
+internal int sdl_work_thread_proc(void *userdata)
+{
+    sdl_work_thread_context *context =
+            static_cast<sdl_work_thread_context*>(userdata);
+    platform_work_queue *queue = context->queue;
+    g_work_thread_index = context->thread_index;
+    sdl_pin_current_thread(context->cpu);
+#if HANDMADE_DIAGNOSTIC
+    profiler_name_thread("worker");
+#endif  // HANDMADE_DIAGNOSTIC
+    while (queue->running.load(std::memory_order_acquire))
+    {
+        while (sdl_do_next_work_entry(queue, g_work_thread_index))
+        {
+        }
+        SDL_SemWait(queue->semaphore);
+    }
+    return 0;
+}
+
+internal bool32 sdl_init_work_queue(platform_work_queue *queue,
+                                   const sdl_thread_layout *layout)
+{
+    bool32 succeeded = false;
+    queue->semaphore = SDL_CreateSemaphore(0);
+    if (!queue->semaphore)
+    {
+        sdl_log_error("SDL_CreateSemaphore");
+        return succeeded;
+    }
+    queue->running.store(true, std::memory_order_release);
+    // the game thread works too, in platform_complete_all_work
+    queue->thread_count = layout->worker_count + 1;
+    for (uint32_t thread_index = 1;
+         thread_index < queue->thread_count;
+         ++thread_index)
+    {
+        sdl_work_thread_context *context = &queue->contexts[thread_index];
+        context->queue = queue;
+        context->thread_index = thread_index;
+        context->cpu = layout->worker_cpus[thread_index - 1];
+        queue->threads[thread_index] = SDL_CreateThread(sdl_work_thread_proc,
+                                                        "worker", context);
+        if (!queue->threads[thread_index])
+        {
+            sdl_log_error("SDL_CreateThread");
+        }
+    }
+    succeeded = true;
+    return succeeded;
+}
+
+internal void sdl_shutdown_work_queue(platform_work_queue *queue)
+{
+    queue->running.store(false, std::memory_order_release);
+    for (uint32_t thread_index = 1;
+         thread_index < queue->thread_count;
+         ++thread_index)
+    {
+        SDL_SemPost(queue->semaphore);
+    }
+    for (uint32_t thread_index = 1;
+         thread_index < queue->thread_count;
+         ++thread_index)
+    {
+        if (queue->threads[thread_index])
+        {
+            SDL_WaitThread(queue->threads[thread_index], nullptr);
+            queue->threads[thread_index] = nullptr;
+        }
+    }
+    queue->thread_count = 0;
+    if (queue->semaphore)
+    {
+        SDL_DestroySemaphore(queue->semaphore);
+        queue->semaphore = nullptr;
+    }
+}
+
+internal void platform_add_entry(platform_work_queue *queue,
+                                 platform_work_queue_callback *callback,
+                                 void *data)
+{
+    // counted before it can be seen, so complete_all_work can't miss it
+    queue->pending.fetch_add(1, std::memory_order_relaxed);
+    sdl_work_deque *own = &queue->deques[g_work_thread_index];
+    if (queue->thread_count == 0 ||
+        !sdl_work_deque_push(own, callback, data))
+    {
+        // no job system or the deque is full, just run it here
+        callback(queue, data);
+        own->jobs_executed.fetch_add(1, std::memory_order_relaxed);
+        queue->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    else if (queue->thread_count > 1)
+    {
+        SDL_SemPost(queue->semaphore);
+    }
+}
+
+internal void platform_complete_all_work(platform_work_queue *queue)
+{
+    HANDMADE_ASSERT(g_work_thread_index == 0);
+    while (queue->pending.load(std::memory_order_acquire) > 0)
+    {
+        if (!sdl_do_next_work_entry(queue, 0))
+        {
+            // the last entries are running on other cores
+            _mm_pause();
+        }
+    }
+}
+
+internal platform_work_queue_stats platform_get_work_queue_stats(
+    platform_work_queue *queue)
+{
+    platform_work_queue_stats result {};
+    for (uint32_t thread_index = 0;
+         thread_index < kSdlMaxWorkThreads;
+         ++thread_index)
+    {
+        const sdl_work_deque *deque = &queue->deques[thread_index];
+        result.jobs_executed +=
+                deque->jobs_executed.load(std::memory_order_relaxed);
+        result.jobs_stolen += deque->jobs_stolen.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+#if HANDMADE_DIAGNOSTIC
+/*
+  Trace export.
+
+  With --trace <file>, every block the profiler finishes is streamed out as
+  Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev open
+  as one timeline row per thread. The game thread only pushes events into a
+  bounded ring from profiler_end_frame; a writer thread formats and writes
+  them. Events that don't fit in the ring are dropped and counted rather
+  than stalling the frame.
+*/
+constexpr uint32_t kSdlTraceQueueSize = 16384;
+constexpr size_t kSdlTraceFileBufferSize = 1 << 20;
+
+struct sdl_trace_writer
+{
+    SDL_Thread *thread;
+    SDL_sem *semaphore;
+    std::atomic<bool> running;
+    FILE *file;
+    // timestamps are relative to this
+    uint64_t base_tsc;
+    // game thread only
+    uint64_t dropped_count;
+    // writer thread only until it's joined
+    uint64_t written_count;
+    bool32 thread_seen[kProfilerMaxThreads];
+    sdl_spsc_ring<profiler_trace_event, kSdlTraceQueueSize> events;
+};
+
+global_variable sdl_trace_writer g_trace_writer {};
+
+internal real64 sdl_trace_us(const sdl_trace_writer *writer, uint64_t tsc)
+{
+    uint64_t ticks = tsc > writer->base_tsc ? tsc - writer->base_tsc : 0;
+    return static_cast<real64>(ticks_to_ns(&g_timer, ticks)) / 1000.0;
+}
+
+internal void sdl_write_trace_event(sdl_trace_writer *writer,
+                                    const profiler_trace_event *event)
+{
+    // names are string literals from TIMED_BLOCK, so nothing to escape
+    real64 begin_us = sdl_trace_us(writer, event->begin_tsc);
+    real64 end_us = sdl_trace_us(writer, event->end_tsc);
+    fprintf(writer->file,
+            ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            event->name, event->thread_index, begin_us, end_us - begin_us);
+    if (event->thread_index < kProfilerMaxThreads)
+    {
+        writer->thread_seen[event->thread_index] = true;
+    }
+    ++writer->written_count;
+}
+
+internal int sdl_trace_thread_proc(void *userdata)
+{
+    sdl_trace_writer *writer = static_cast<sdl_trace_writer*>(userdata);
+    sdl_pin_current_thread(g_thread_layout.helper_cpu);
+    bool32 running = true;
+    while (running)
+    {
+        // read before draining, so nothing pushed before a stop is missed
+        running = writer->running.load(std::memory_order_acquire);
+        profiler_trace_event event {};
+        while (sdl_spsc_pop(&writer->events, &event))
+        {
+            sdl_write_trace_event(writer, &event);
+        }
+        if (running)
+        {
+            SDL_SemWait(writer->semaphore);
+        }
+    }
+    return 0;
+}
+
+internal PROFILER_TRACE_PROC(sdl_push_trace_event)
+{
+    sdl_trace_writer *writer = static_cast<sdl_trace_writer*>(user_data);
+    if (!sdl_spsc_push(&writer->events, *event))
+    {
+        ++writer->dropped_count;
+    }
+}
+
+internal bool32 sdl_begin_trace(sdl_trace_writer *writer, const char *filename)
+{
+    bool32 succeeded = false;
+    writer->file = fopen(filename, "wb");
+    if (!writer->file)
+    {
+        printf("Can't open %s for the trace\n", filename);
+        return succeeded;
+    }
+    setvbuf(writer->file, nullptr, _IOFBF, kSdlTraceFileBufferSize);
+    // the first entry makes every event one ",\n{...}"
+    fprintf(writer->file,
+            "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"args\":{\"name\":\"handmade\"}}");
+    writer->base_tsc = read_tsc();
+    writer->semaphore = SDL_CreateSemaphore(0);
+    if (!writer->semaphore)
+    {
+        sdl_log_error("SDL_CreateSemaphore");
+        fclose(writer->file);
+        writer->file = nullptr;
+        return succeeded;
+    }
+    writer->running.store(true, std::memory_order_release);
+    writer->thread = SDL_CreateThread(sdl_trace_thread_proc, "trace", writer);
+    if (!writer->thread)
+    {
+        sdl_log_error("SDL_CreateThread");
+        SDL_DestroySemaphore(writer->semaphore);
+        writer->semaphore = nullptr;
+        fclose(writer->file);
+        writer->file = nullptr;
+        return succeeded;
+    }
+    profiler_set_trace_proc(sdl_push_trace_event, writer);
+    if (!g_timer.uses_tsc)
+    {
+        printf("trace: no invariant TSC, timestamps are approximate\n");
+    }
+    succeeded = true;
+    return succeeded;
+}
+
+// once a frame after profiler_end_frame, wakes the writer for what it pushed
+internal void sdl_flush_trace(sdl_trace_writer *writer)
+{
+    if (writer->thread)
+    {
+        SDL_SemPost(writer->semaphore);
+    }
+}
+
+internal void sdl_end_trace(sdl_trace_writer *writer)
+{
+    if (!writer->thread)
+    {
+        return;
+    }
+    profiler_set_trace_proc(nullptr, nullptr);
+    writer->running.store(false, std::memory_order_release);
+    SDL_SemPost(writer->semaphore);
+    SDL_WaitThread(writer->thread, nullptr);
+    writer->thread = nullptr;
+    SDL_DestroySemaphore(writer->semaphore);
+    writer->semaphore = nullptr;
+
+    // thread names last, the viewers don't care where they are
+    for (uint32_t thread_index = 0;
+         thread_index < kProfilerMaxThreads;
+         ++thread_index)
+    {
+        if (writer->thread_seen[thread_index])
+        {
+            const char *name = profiler_get_thread_name(thread_index);
+            fprintf(writer->file,
+                    ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                    thread_index, name ? name : "thread", thread_index);
+        }
+    }
+    fprintf(writer->file, "\n]}\n");
+    fclose(writer->file);
+    writer->file = nullptr;
+    printf("trace: %" PRIu64 " events written, %" PRIu64 " dropped\n",
+           writer->written_count, writer->dropped_count);
+}
+#endif  // HANDMADE_DIAGNOSTIC
+
+/*
+  Frame time statistics.
+
+  Every frame time goes into an HDR histogram, so stutter shows up in the
+  tail percentiles instead of vanishing into an average. The whole run is
+  reported at exit; with --stats-interval <seconds> the frames since the last
+  report are also printed every interval. The deadline is the game frame
+  period, and a frame over it by more than 2% counts as missed.
+*/
+#include "handmade_histogram.h"
+
+// paced frames land a little past the deadline, only later than this misses
+constexpr uint64_t kSdlFrameDeadlineSlackDivisor = 50;
+
+struct sdl_frame_stats
+{
+    uint64_t deadline_ns;
+    // 0 to only report at exit
+    uint64_t report_interval_ns;
+    uint64_t interval_elapsed_ns;
+    uint64_t missed_count;
+    uint64_t interval_missed_count;
+    histogram total;
+    histogram interval;
+};
+
+global_variable sdl_frame_stats g_frame_stats {};
+
+internal void sdl_init_frame_stats(sdl_frame_stats *stats, uint64_t deadline_ns,
+                                   uint64_t report_interval_ns)
+{
+    stats->deadline_ns = deadline_ns;
+    stats->report_interval_ns = report_interval_ns;
+    stats->interval_elapsed_ns = 0;
+    stats->missed_count = 0;
+    stats->interval_missed_count = 0;
+    histogram_reset(&stats->total);
+    histogram_reset(&stats->interval);
+}
+
+internal real64 sdl_ns_to_ms(uint64_t ns)
+{
+    return static_cast<real64>(ns) / 1000000.0;
+}
+
+internal void sdl_print_frame_histogram(const char *label,
+                                        const histogram *hist,
+                                        uint64_t missed_count,
+                                        uint64_t deadline_ns)
+{
+    if (hist->count == 0)
+    {
+        return;
+    }
+    printf("%s: %" PRIu64 " frames, ms min %.2f p50 %.2f p90 %.2f p99 %.2f "
+           "p99.9 %.2f max %.2f, %" PRIu64 " over %.2f ms (%.2f%%)\n",
+           label, hist->count, sdl_ns_to_ms(hist->min),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.5)),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.9)),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.99)),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.999)),
+           sdl_ns_to_ms(hist->max), missed_count, sdl_ns_to_ms(deadline_ns),
+           100.0 * static_cast<real64>(missed_count) /
+           static_cast<real64>(hist->count));
+}
+
+// returns true when it printed an interval report
+internal bool32 sdl_record_frame_time(sdl_frame_stats *stats,
+                                      uint64_t frame_ns)
+{
+    bool32 reported = false;
+    histogram_record(&stats->total, frame_ns);
+    histogram_record(&stats->interval, frame_ns);
+    if (frame_ns > stats->deadline_ns +
+        stats->deadline_ns / kSdlFrameDeadlineSlackDivisor)
+    {
+        ++stats->missed_count;
+        ++stats->interval_missed_count;
+    }
+    stats->interval_elapsed_ns += frame_ns;
+    if (stats->report_interval_ns &&
+        stats->interval_elapsed_ns >= stats->report_interval_ns)
+    {
+        sdl_print_frame_histogram("frames", &stats->interval,
+                                  stats->interval_missed_count,
+                                  stats->deadline_ns);
+        histogram_reset(&stats->interval);
+        stats->interval_missed_count = 0;
+        stats->interval_elapsed_ns = 0;
+        reported = true;
+    }
+    return reported;
+}
+
+/*
+  Input latency.
+
+  Every frame records how long it was from reading the controllers to
+  presenting the image drawn from them, and on frames where some input
+  changed, from the earliest change to the present. Keyboard changes are
+  dated from their SDL event, so time spent queued counts; pad changes are
+  dated from when they were read. The present is when SDL_RenderPresent
+  returns, which is before the image reaches the screen.
+*/
+struct sdl_input_latency
+{
+    histogram sample_to_present_ns;
+    histogram change_to_present_ns;
+};
+
+global_variable sdl_input_latency g_input_latency {};
+
+internal void sdl_init_input_latency(sdl_input_latency *latency)
+{
+    histogram_reset(&latency->sample_to_present_ns);
+    histogram_reset(&latency->change_to_present_ns);
+}
+
+internal void sdl_record_input_latency(sdl_input_latency *latency,
+                                       const game_input *input,
+                                       uint64_t present_counter)
+{
+    if (input->sample_counter && input->sample_counter <= present_counter)
+    {
+        histogram_record(&latency->sample_to_present_ns,
+                         ticks_to_ns(&g_timer,
+                                     present_counter - input->sample_counter));
+    }
+    uint64_t change_counter = 0;
+    for (int32_t controller_index = 0;
+         controller_index < game_input::max_controller_count;
+         ++controller_index)
+    {
+        uint64_t counter = input->change_counters[controller_index];
+        if (counter && (!change_counter || counter < change_counter))
+        {
+            change_counter = counter;
+        }
+    }
+    if (change_counter && change_counter <= present_counter)
+    {
+        histogram_record(&latency->change_to_present_ns,
+                         ticks_to_ns(&g_timer,
+                                     present_counter - change_counter));
+    }
+}
+
+internal void sdl_print_latency_histogram(const char *label,
+                                          const histogram *hist)
+{
+    if (hist->count == 0)
+    {
+        return;
+    }
+    printf("%s: %" PRIu64 " frames, ms min %.2f p50 %.2f p90 %.2f p99 %.2f "
+           "max %.2f\n",
+           label, hist->count, sdl_ns_to_ms(hist->min),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.5)),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.9)),
+           sdl_ns_to_ms(histogram_percentile(hist, 0.99)),
+           sdl_ns_to_ms(hist->max));
+}
+
+internal void sdl_print_input_latency(const sdl_input_latency *latency)
+{
+    sdl_print_latency_histogram("input read to present",
+                                &latency->sample_to_present_ns);
+    sdl_print_latency_histogram("input change to present",
+                                &latency->change_to_present_ns);
+}
+
+/*
+  Hardware performance counters.
+
+  With --perf-counters on linux, the game thread opens one perf_event group
+  counting its own user space cycles, instructions, cache misses, branch
+  misses and data TLB misses, and reads it around each frame stage. Per
+  stage deltas are summed and reported as per frame averages with IPC
+  alongside the frame time statistics. Counters the cpu, kernel or
+  perf_event_paranoid don't allow are left out; without cycles nothing is
+  counted. Only the game thread is counted, not jobs it hands to workers.
+*/
+enum sdl_perf_counter
+{
+    sdl_perf_counter_cycles,
+    sdl_perf_counter_instructions,
+    sdl_perf_counter_cache_misses,
+    sdl_perf_counter_branch_misses,
+    sdl_perf_counter_dtlb_misses,
+
+    sdl_perf_counter_count
+};
+
+global_variable const char *kSdlPerfCounterNames[] = {
+    "cycles", "instrs", "cache-miss", "branch-miss", "dtlb-miss"
+};
+
+enum sdl_perf_stage
+{
+    sdl_perf_stage_update_and_render,
+    sdl_perf_stage_sound,
+    sdl_perf_stage_update_texture,
+    sdl_perf_stage_present,
+
+    sdl_perf_stage_count
+};
+
+global_variable const char *kSdlPerfStageNames[] = {
+    "game_update_and_render", "sound fill", "SDL_UpdateTexture", "present"
+};
+
+struct sdl_perf_totals
+{
+    uint64_t frame_count;
+    uint64_t values[sdl_perf_stage_count][sdl_perf_counter_count];
+};
+
+struct sdl_perf_counters
+{
+    bool32 is_open;
+    // the group leader is the cycles counter
+    int fds[sdl_perf_counter_count];
+    uint64_t ids[sdl_perf_counter_count];
+    // the kernel had to share the pmu with something else at some point
+    bool32 multiplexed;
+    uint64_t stage_begin[sdl_perf_counter_count];
+    sdl_perf_totals interval;
+    sdl_perf_totals total;
+};
+
+global_variable sdl_perf_counters g_perf_counters {};
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+internal void sdl_perf_event_attr(sdl_perf_counter counter,
+                                  perf_event_attr *attr)
+{
+    *attr = {};
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (counter)
+    {
+    case sdl_perf_counter_cycles:
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case sdl_perf_counter_instructions:
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case sdl_perf_counter_cache_misses:
+        attr->config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case sdl_perf_counter_branch_misses:
+        attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case sdl_perf_counter_dtlb_misses:
+    case sdl_perf_counter_count:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    }
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // user space only, which is also all perf_event_paranoid 2 allows
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->disabled = counter == sdl_perf_counter_cycles;
+}
+
+internal bool32 sdl_open_perf_counters(sdl_perf_counters *counters)
+{
+    bool32 succeeded = false;
+    *counters = {};
+    std::fill(counters->fds, counters->fds + sdl_perf_counter_count, -1);
+    for (int32_t counter_index = 0;
+         counter_index < sdl_perf_counter_count;
+         ++counter_index)
+    {
+        int group_fd = counters->fds[sdl_perf_counter_cycles];
+        perf_event_attr attr;
+        sdl_perf_event_attr(static_cast<sdl_perf_counter>(counter_index),
+                            &attr);
+        // this thread on any cpu
+        long fd = syscall(SYS_perf_event_open, &attr, 0, -1,
+                          counter_index ? group_fd : -1, 0);
+        if (fd < 0)
+        {
+            printf("perf counters: no %s (%s)\n",
+                   kSdlPerfCounterNames[counter_index], std::strerror(errno));
+            if (counter_index == sdl_perf_counter_cycles)
+            {
+                return succeeded;
+            }
+            continue;
+        }
+        counters->fds[counter_index] = static_cast<int>(fd);
+        ioctl(counters->fds[counter_index], PERF_EVENT_IOC_ID,
+              &counters->ids[counter_index]);
+    }
+    int leader = counters->fds[sdl_perf_counter_cycles];
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    counters->is_open = true;
+    succeeded = true;
+    return succeeded;
+}
+
+internal void sdl_close_perf_counters(sdl_perf_counters *counters)
+{
+    if (!counters->is_open)
+    {
+        return;
+    }
+    for (uint32_t counter_index = 0;
+         counter_index < sdl_perf_counter_count;
+         ++counter_index)
+    {
+        if (counters->fds[counter_index] >= 0)
+        {
+            close(counters->fds[counter_index]);
+            counters->fds[counter_index] = -1;
+        }
+    }
+    counters->is_open = false;
+}
+
+// one read for the whole group; counters that failed to open read as 0
+internal void sdl_read_perf_counters(sdl_perf_counters *counters,
+                                     uint64_t values[sdl_perf_counter_count])
+{
+    // nr, time enabled, time running, then a value and id per counter
+    uint64_t buffer[3 + 2 * sdl_perf_counter_count];
+    ssize_t bytes = read(counters->fds[sdl_perf_counter_cycles], buffer,
+                         sizeof(buffer));
+    std::memset(values, 0, sizeof(uint64_t) * sdl_perf_counter_count);
+    if (bytes < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+    {
+        return;
+    }
+    counters->multiplexed = counters->multiplexed || buffer[1] != buffer[2];
+    for (uint64_t entry_index = 0;
+         entry_index < buffer[0] && entry_index < sdl_perf_counter_count;
+         ++entry_index)
+    {
+        uint64_t value = buffer[3 + 2 * entry_index];
+        uint64_t id = buffer[4 + 2 * entry_index];
+        for (uint32_t counter_index = 0;
+             counter_index < sdl_perf_counter_count;
+             ++counter_index)
+        {
+            if (counters->fds[counter_index] >= 0 &&
+                counters->ids[counter_index] == id)
+            {
+                values[counter_index] = value;
+            }
+        }
+    }
+}
+#else  // defined(__linux__)
+internal bool32 sdl_open_perf_counters(sdl_perf_counters *counters)
+{
+    *counters = {};
+    std::fill(counters->fds, counters->fds + sdl_perf_counter_count, -1);
+    printf("perf counters: only supported on linux\n");
+    return false;
+}
+
+internal void sdl_close_perf_counters(sdl_perf_counters *counters)
+{
+    counters->is_open = false;
+}
+
+internal void sdl_read_perf_counters(sdl_perf_counters *,
+                                     uint64_t values[sdl_perf_counter_count])
+{
+    std::memset(values, 0, sizeof(uint64_t) * sdl_perf_counter_count);
+}
+#endif  // defined(__linux__)
+
+internal void sdl_begin_perf_stage(sdl_perf_counters *counters)
+{
+    if (counters->is_open)
+    {
+        sdl_read_perf_counters(counters, counters->stage_begin);
+    }
+}
+
+internal void sdl_end_perf_stage(sdl_perf_counters *counters,
+                                 sdl_perf_stage stage)
+{
+    if (counters->is_open)
+    {
+        uint64_t values[sdl_perf_counter_count];
+        sdl_read_perf_counters(counters, values);
+        for (uint32_t counter_index = 0;
+             counter_index < sdl_perf_counter_count;
+             ++counter_index)
+        {
+            uint64_t delta = values[counter_index] -
+                    counters->stage_begin[counter_index];
+            counters->interval.values[stage][counter_index] += delta;
+            counters->total.values[stage][counter_index] += delta;
+        }
+    }
+}
+
+internal void sdl_end_perf_frame(sdl_perf_counters *counters)
+{
+    ++counters->interval.frame_count;
+    ++counters->total.frame_count;
+}
+
+internal void sdl_print_perf_totals(const sdl_perf_counters *counters,
+                                    const sdl_perf_totals *totals)
+{
+    if (!counters->is_open || totals->frame_count == 0)
+    {
+        return;
+    }
+    printf("  %-24s", "per frame");
+    for (uint32_t counter_index = 0;
+         counter_index < sdl_perf_counter_count;
+         ++counter_index)
+    {
+        printf(" %12s", kSdlPerfCounterNames[counter_index]);
+    }
+    printf(" %6s%s\n", "IPC", counters->multiplexed ? " (multiplexed)" : "");
+    real64 frame_count = static_cast<real64>(totals->frame_count);
+    for (uint32_t stage_index = 0;
+         stage_index < sdl_perf_stage_count;
+         ++stage_index)
+    {
+        const uint64_t *values = totals->values[stage_index];
+        printf("  %-24s", kSdlPerfStageNames[stage_index]);
+        for (uint32_t counter_index = 0;
+             counter_index < sdl_perf_counter_count;
+             ++counter_index)
+        {
+            if (counters->fds[counter_index] >= 0)
+            {
+                printf(" %12.0f",
+                       static_cast<real64>(values[counter_index]) /
+                       frame_count);
+            }
+            else
+            {
+                printf(" %12s", "-");
+            }
+        }
+        uint64_t cycles = values[sdl_perf_counter_cycles];
+        real64 ipc = cycles ?
+                static_cast<real64>(values[sdl_perf_counter_instructions]) /
+                static_cast<real64>(cycles) : 0.0;
+        printf(" %6.2f\n", ipc);
+    }
 }
-#endif  // __clang__
-
-#endif  // platform check
 
-#include <SDL.h>
+/*
+  Display refresh.
 
-// constants
-constexpr const char *kSdlControllerMappingFile = "./data/sdl_gamecontroller_db/gamecontrollerdb.txt";
-constexpr real32 kSdlControllerMaxStickVal = 32767.0f;
-// constexpr real32 kSdlControllerMinStickVal = -32768;
+  The game updates once per vblank, or every second or third vblank on
+  displays faster than kMaxGameUpdateHz, so each game frame is on screen for
+  the same number of refreshes. Frames are paced to that rate (--target-hz
+  overrides it) and the game gets the frame period as dt_for_frame. SDL's
+  renderer can only vsync to every refresh, so presents aren't vsynced; a
+  frame taking longer than its vblanks is counted as having missed the ones
+  it ran over instead.
+*/
+constexpr uint32_t kSdlDefaultRefreshHz = 60;
+constexpr uint64_t kSdlNsPerSec = 1000000000ULL;
 
-internal real32 sdl_get_controller_stick_normalized_deadzone(
-    real32 unnormalized_deadzone)
+internal void sdl_init_display_timing(sdl_display_timing *timing,
+                                      SDL_Window *window, uint32_t target_hz)
 {
-    return unnormalized_deadzone / std::sqrt(
-        kSdlControllerMaxStickVal * kSdlControllerMaxStickVal * 2.0f);
+    uint32_t refresh_hz = kSdlDefaultRefreshHz;
+    SDL_DisplayMode mode {};
+    int32_t display_index = SDL_GetWindowDisplayIndex(window);
+    if (display_index < 0 ||
+        SDL_GetCurrentDisplayMode(display_index, &mode) != 0)
+    {
+        sdl_log_error("SDL_GetCurrentDisplayMode");
+    }
+    else if (mode.refresh_rate > 0)
+    {
+        // 0 when the driver doesn't know, the default stays then
+        refresh_hz = static_cast<uint32_t>(mode.refresh_rate);
+    }
+    timing->refresh_hz = refresh_hz;
+    timing->vblank_ns = kSdlNsPerSec / refresh_hz;
+    if (target_hz)
+    {
+        timing->game_update_hz = target_hz;
+        timing->vblanks_per_frame = std::max(
+            (refresh_hz + target_hz / 2) / target_hz, 1u);
+    }
+    else
+    {
+        timing->vblanks_per_frame = get_vblanks_per_game_update(refresh_hz);
+        timing->game_update_hz = refresh_hz / timing->vblanks_per_frame;
+    }
+    timing->dt_for_frame = 1.0f / static_cast<real32>(timing->game_update_hz);
+    timing->late_frame_count = 0;
+    timing->missed_vblank_count = 0;
+    printf("display: %u Hz, game updates at %u Hz\n", timing->refresh_hz,
+           timing->game_update_hz);
 }
 
-struct sdl_offscreen_buffer
+internal void sdl_record_vblanks(sdl_display_timing *timing, uint64_t frame_ns)
 {
-    SDL_Texture *texture;
-    int32_t width;
-    int32_t height;
-    ptrdiff_t pitch;
-    void *memory;
-};
+    // to the nearest vblank, paced frames end a little after theirs
+    uint64_t vblanks = (frame_ns + timing->vblank_ns / 2) / timing->vblank_ns;
+    if (vblanks > timing->vblanks_per_frame)
+    {
+        ++timing->late_frame_count;
+        timing->missed_vblank_count += vblanks - timing->vblanks_per_frame;
+    }
+}
 
-struct sdl_sound_ring_buffer
+internal void sdl_print_display_timing(const sdl_display_timing *timing)
 {
-    size_t size;
-    volatile size_t play_cursor;
-    void *memory;
-};
+    printf("vblanks: %u Hz display, %u per game frame, %" PRIu64
+           " missed by %" PRIu64 " late frames\n",
+           timing->refresh_hz, timing->vblanks_per_frame,
+           timing->missed_vblank_count, timing->late_frame_count);
+}
 
-struct sdl_sound_output
-{
-    sdl_sound_ring_buffer ring_buffer;
-    uint32_t running_sample_index;
-    uint32_t num_sound_ch;
-    uint32_t samples_per_sec;
-    uint32_t sec_to_buffer;
-    SDL_AudioFormat sdl_audio_format;
-    uint32_t sdl_audio_buffer_size_in_samples;
+/*
+  Frame pacing.
 
-    // calculated values
-    uint32_t latency_sample_count;  // to minimize delay when we want to change the sound
-    uint32_t bytes_per_sample;
-    uint32_t sdl_audio_buffer_size_in_bytes;
-};
+  Unless --unthrottled, every frame is stretched to the game frame period
+  instead of running flat out. The pacer sleeps through most of what's left
+  of the frame and spins for the rest, because a sleep can wake late but a
+  spin can't. How late sleeps wake is measured every frame, and the spin
+  threshold follows it: it jumps up to cover any new worst overshoot and
+  slowly decays back down, so CPU time spent spinning stays small.
+*/
+constexpr uint64_t kSdlMinSpinNs = 50000;
+constexpr uint64_t kSdlMaxSpinNs = 4000000;
+// spin this much longer than the worst recent overshoot
+constexpr uint64_t kSdlSpinMarginNs = 20000;
 
-struct sdl_game_controllers
+struct sdl_frame_pacer
 {
-    SDL_GameController *controllers[game_input::max_controller_count - 1];
-    SDL_Haptic *haptics[game_input::max_controller_count - 1];
-    int32_t num_controllers_active;
+    // 0 when frames aren't paced
+    uint64_t target_frame_ns;
+    uint64_t target_frame_ticks;
+    uint64_t spin_ns;
+    uint64_t sleep_count;
+    histogram overshoot_ns;
 };
 
-// globals
-global_variable bool32 g_running = false;
-global_variable sdl_offscreen_buffer g_backbuffer {};
-
+global_variable sdl_frame_pacer g_frame_pacer {};
 
-internal void sdl_log_error(const char* func_name)
+internal void sdl_init_frame_pacer(sdl_frame_pacer *pacer,
+                                   const timer_info *timer, uint32_t target_hz)
 {
-    printf("%s failed: %s\n", func_name, SDL_GetError());
+    pacer->target_frame_ns = target_hz ? kSdlNsPerSec / target_hz : 0;
+    pacer->target_frame_ticks =
+            target_hz ? timer->ticks_per_sec / target_hz : 0;
+    pacer->spin_ns = 1000000;
+    pacer->sleep_count = 0;
+    histogram_reset(&pacer->overshoot_ns);
 }
 
-#if HANDMADE_INTERNAL_BUILD
+internal void sdl_sleep_ns(uint64_t ns)
+{
+#if defined(__linux__)
+    timespec duration {};
+    duration.tv_sec = static_cast<time_t>(ns / 1000000000ULL);
+    duration.tv_nsec = static_cast<long>(ns % 1000000000ULL);
+    // restarts with what's left if a signal cuts it short
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &duration, &duration) == EINTR)
+    {
+    }
+#else  // defined(__linux__)
+    SDL_Delay(static_cast<uint32_t>(ns / 1000000));
+#endif  // defined(__linux__)
+}
 
-// for debugging only, so just ansi filenames
-internal debug_read_file_result debug_platform_read_entire_file(
-    const char *filename)
+// returns once the timer reaches deadline, a tick count from read_timer
+internal void sdl_wait_for_frame_end(sdl_frame_pacer *pacer,
+                                     const timer_info *timer, uint64_t deadline)
 {
-    // open file
-    // get file size
-    // alloc buffer
-    // read entire file
-    // close file
-    debug_read_file_result result {};
-    SDL_RWops *file = SDL_RWFromFile(filename, "rb");
-    if (file)
+    TIMED_BLOCK("sdl_wait_for_frame_end");
+    uint64_t now = read_timer(timer);
+    if (now >= deadline)
     {
-        int64_t filesize = SDL_RWsize(file);
-        if (filesize >= 0)
+        // late, the next frame is paced from here
+        return;
+    }
+    uint64_t remaining_ns = ticks_to_ns(timer, deadline - now);
+    if (remaining_ns > pacer->spin_ns)
+    {
+        uint64_t sleep_ns = remaining_ns - pacer->spin_ns;
+        sdl_sleep_ns(sleep_ns);
+        uint64_t slept_ns = ticks_to_ns(timer, read_timer(timer) - now);
+        uint64_t overshoot_ns = slept_ns > sleep_ns ? slept_ns - sleep_ns : 0;
+        histogram_record(&pacer->overshoot_ns, overshoot_ns);
+        ++pacer->sleep_count;
+
+        // up at once, down by 1/64 a frame
+        uint64_t wanted_spin_ns = std::min(overshoot_ns + kSdlSpinMarginNs,
+                                           kSdlMaxSpinNs);
+        if (wanted_spin_ns > pacer->spin_ns)
         {
-            result.size = safe_truncate_int64_uint32(filesize);
-            result.content = platform_alloc_zeroed(nullptr, result.size);
-            if (result.content)
-            {
-                if (1 == SDL_RWread(file, result.content, result.size, 1))
-                {
-                    // NOTE: file read successfully
-                }
-                else
-                {
-                    sdl_log_error("SDL_RWread");
-                    debug_platform_free_file_memory(&result);
-                }
-            }
-            else
-            {
-                // TODO: logging
-            }
+            pacer->spin_ns = wanted_spin_ns;
         }
         else
         {
-            // TODO: logging
-            sdl_log_error("SDL_RWops");
-        }
-        if (0 != SDL_RWclose(file))
-        {
-            sdl_log_error("SDL_RWclose");
+            pacer->spin_ns = std::max(pacer->spin_ns - pacer->spin_ns / 64,
+                                      kSdlMinSpinNs);
         }
     }
-    else
+    while (read_timer(timer) < deadline)
     {
-        // TODO: logging
-        sdl_log_error("SDL_RWFromFile");
+        _mm_pause();
     }
-    return result;
 }
 
-internal void debug_platform_free_file_memory(debug_read_file_result *file_mem)
+internal void sdl_print_frame_pacer(const sdl_frame_pacer *pacer)
 {
-    platform_free(file_mem->content, file_mem->size);
-    file_mem->content = nullptr;
-    file_mem->size = 0;
+    if (!pacer->target_frame_ns)
+    {
+        return;
+    }
+    const histogram *overshoot = &pacer->overshoot_ns;
+    printf("pacing: %.2f ms frames, %" PRIu64 " sleeps, overshoot us p50 %.1f "
+           "p99 %.1f max %.1f, spin %.1f us\n",
+           sdl_ns_to_ms(pacer->target_frame_ns), pacer->sleep_count,
+           static_cast<real64>(histogram_percentile(overshoot, 0.5)) / 1000.0,
+           static_cast<real64>(histogram_percentile(overshoot, 0.99)) / 1000.0,
+           static_cast<real64>(overshoot->max) / 1000.0,
+           static_cast<real64>(pacer->spin_ns) / 1000.0);
 }
 
-internal bool32 debug_platform_write_entire_file(const char *filename,
-                                                 void *memory,
-                                                 uint32_t mem_size)
+/*
+  Fixed timestep.
+
+  With --fixed-step-hz the game simulates in steps of exactly that period,
+  whatever the frame rate. Each frame adds the real time since the last one
+  to an accumulator and runs as many whole steps as it holds, none on fast
+  frames, and renders alpha of the way between the last two steps. Catching
+  up is capped at kSdlMaxCatchUpSteps a frame; anything over is dropped, so
+  a slow host runs the game slower instead of spending ever longer frames
+  on catch up. Button transitions and input events go to the first step
+  after they happen: they build up over frames that run no step, and the
+  steps after the first in a frame see none. Input is recorded and played
+  back per step, so playback simulates the same whatever the frame times
+  were, as long as no button changes more than once within a step
+  (recordings keep only ended_down, see game_packed_controller).
+*/
+constexpr uint32_t kSdlMaxCatchUpSteps = 5;
+
+struct sdl_fixed_step
 {
-    // open file
-    // write entire file
-    // close file
-    bool32 result = false;
-    SDL_RWops *file = SDL_RWFromFile(filename, "wb");
-    if (file)
+    // 0 when the game updates once a frame
+    uint64_t step_ns;
+    real32 step_dt;
+    uint64_t accumulator_ns;
+    uint64_t step_count;
+    uint64_t capped_frame_count;
+    uint64_t dropped_ns;
+};
+
+global_variable sdl_fixed_step g_fixed_step {};
+
+internal void sdl_init_fixed_step(sdl_fixed_step *fixed_step, uint32_t step_hz)
+{
+    *fixed_step = {};
+    if (step_hz)
     {
-        if (SDL_RWwrite(file, memory, mem_size, 1) == 1)
-        {
-            result = true;
-        }
-        else
-        {
-            // TODO: logging
-            sdl_log_error("SDL_RWwrite");
-        }
-        if (0 != SDL_RWclose(file))
-        {
-            sdl_log_error("SDL_RWclose");
-        }
+        fixed_step->step_ns = kSdlNsPerSec / step_hz;
+        fixed_step->step_dt = 1.0f / static_cast<real32>(step_hz);
+        // the first frame renders the initial state after one step
+        fixed_step->accumulator_ns = fixed_step->step_ns;
     }
-    else
+}
+
+// how many steps to run this frame, given how long the last one took
+internal uint32_t sdl_advance_fixed_step(sdl_fixed_step *fixed_step,
+                                         uint64_t elapsed_ns)
+{
+    fixed_step->accumulator_ns += elapsed_ns;
+    uint64_t step_count = fixed_step->accumulator_ns / fixed_step->step_ns;
+    fixed_step->accumulator_ns -= step_count * fixed_step->step_ns;
+    if (step_count > kSdlMaxCatchUpSteps)
     {
-        // TODO: logging
-        sdl_log_error("SDL_RWFromFile");
+        uint64_t dropped_steps = step_count - kSdlMaxCatchUpSteps;
+        fixed_step->dropped_ns += dropped_steps * fixed_step->step_ns;
+        ++fixed_step->capped_frame_count;
+        step_count = kSdlMaxCatchUpSteps;
     }
+    fixed_step->step_count += step_count;
+    return static_cast<uint32_t>(step_count);
+}
 
-    return result;
+// how far the frame is between the last two steps, 0..1
+internal real32 sdl_get_fixed_step_alpha(const sdl_fixed_step *fixed_step)
+{
+    return static_cast<real32>(fixed_step->accumulator_ns) /
+            static_cast<real32>(fixed_step->step_ns);
 }
 
-#endif // HANDMADE_INTERNAL_BUILD
+internal void sdl_print_fixed_step(const sdl_fixed_step *fixed_step)
+{
+    if (!fixed_step->step_ns)
+    {
+        return;
+    }
+    printf("fixed step: %.2f ms, %" PRIu64 " steps, %" PRIu64
+           " frames hit the catch up cap, %.2f ms dropped\n",
+           sdl_ns_to_ms(fixed_step->step_ns), fixed_step->step_count,
+           fixed_step->capped_frame_count,
+           sdl_ns_to_ms(fixed_step->dropped_ns));
+}
 
 internal void sdl_cleanup(SDL_Window *window, SDL_Renderer *renderer,
                           SDL_Texture *texture, SDL_AudioDeviceID audio_dev_id,
@@ -284,7 +3050,7 @@ internal void sdl_cleanup(SDL_Window *window, SDL_Renderer *renderer,
 {
     if (controllers)
     {
-        for (int32_t i = 0; i < game_input::max_controller_count; ++i)
+        for (int32_t i = 0; i < game_input::max_controller_count - 1; ++i)
         {
             auto *controller = controllers->controllers[i];
             if (controller)
@@ -297,6 +3063,7 @@ internal void sdl_cleanup(SDL_Window *window, SDL_Renderer *renderer,
                 SDL_GameControllerClose(controller);
             }
         }
+        platform_unmap_file(&controllers->mapping_db);
     }
 
     if (audio_dev_id != 0)
@@ -465,6 +3232,18 @@ internal void sdl_audio_callback(void *userdata, uint8_t* stream, int32_t len)
             static_cast<sdl_sound_ring_buffer*>(userdata);
     size_t len_in_size = static_cast<size_t>(len);
 
+    // SDL owns the audio thread, this is the first chance to pin it
+    local_persist bool32 thread_pinned = false;
+    if (!thread_pinned)
+    {
+        sdl_pin_current_thread(g_thread_layout.helper_cpu);
+#if HANDMADE_DIAGNOSTIC
+        profiler_name_thread("audio");
+#endif  // HANDMADE_DIAGNOSTIC
+        thread_pinned = true;
+    }
+    TIMED_BLOCK("sdl_audio_callback");
+
     // grab data from ring buffer to fill the sdl audio buffer
     size_t region_1_size = len_in_size;
     size_t region_2_size = 0;
@@ -487,129 +3266,488 @@ internal void sdl_audio_callback(void *userdata, uint8_t* stream, int32_t len)
             % ring_buffer->size;
 }
 
+// sdl flips y-axis compared to xinput
 internal real32 sdl_thumb_stick_resolve_deadzone_normalize(
     real32 val, real32 deadzone)
 {
-    // normalize the input first (-1.0f to 1.0f)
-    // max with -1 because abs(min val) is 1 great then max val
-    val = std::max(-1.0f, val / kSdlControllerMaxStickVal);
+    return resolve_stick_deadzone(val, kSdlControllerMaxStickVal, deadzone);
+}
+
+// keeps the earliest change of the frame
+internal void sdl_note_input_change(game_input *input, int32_t controller_index,
+                                   uint64_t counter)
+{
+    uint64_t *change_counter = &input->change_counters[controller_index];
+    if (*change_counter == 0 || counter < *change_counter)
+    {
+        *change_counter = counter;
+    }
+}
+
+// SDL stamps events in SDL_GetTicks ms, so this goes back from now by the
+// event's age; only good to a ms, but it counts the time spent queued
+internal uint64_t sdl_get_event_counter(uint32_t event_ms)
+{
+    uint64_t now = read_timer(&g_timer);
+    uint64_t age_ticks = static_cast<uint64_t>(SDL_GetTicks() - event_ms) *
+            g_timer.ticks_per_sec / 1000;
+    return now > age_ticks ? now - age_ticks : now;
+}
+
+internal bool32 sdl_controller_changed(const game_controller_input *new_state,
+                                       const game_controller_input *old_state)
+{
+    // bitwise, both come from the same deadzone math on the same raw value
+    // when the stick hasn't moved
+    bool32 changed =
+            std::memcmp(&new_state->left_stick, &old_state->left_stick,
+                        sizeof(game_analog_stick_state)) != 0 ||
+            std::memcmp(&new_state->right_stick, &old_state->right_stick,
+                        sizeof(game_analog_stick_state)) != 0;
+    for (uint32_t button_index = 0;
+         button_index < array_length(new_state->buttons) && !changed;
+         ++button_index)
+    {
+        changed = new_state->buttons[button_index].ended_down !=
+                old_state->buttons[button_index].ended_down;
+    }
+    return changed;
+}
+
+internal void sdl_read_controller_sticks(game_controller_input *new_controller,
+                                         SDL_GameController *sdl_controller,
+                                         real32 left_thumb_norm_deadzone,
+                                         real32 right_thumb_norm_deadzone)
+{
+    // SDL stick's Y has opposite sign than XInput
+    real32 left_stick_x = static_cast<real32>(
+        SDL_GameControllerGetAxis(sdl_controller, SDL_CONTROLLER_AXIS_LEFTX));
+    real32 left_stick_y = static_cast<real32>(
+        SDL_GameControllerGetAxis(sdl_controller, SDL_CONTROLLER_AXIS_LEFTY));
+    real32 right_stick_x = static_cast<real32>(
+        SDL_GameControllerGetAxis(sdl_controller, SDL_CONTROLLER_AXIS_RIGHTX));
+    real32 right_stick_y = static_cast<real32>(
+        SDL_GameControllerGetAxis(sdl_controller, SDL_CONTROLLER_AXIS_RIGHTY));
+
+    new_controller->left_stick.avg_x =
+            sdl_thumb_stick_resolve_deadzone_normalize(
+                left_stick_x, left_thumb_norm_deadzone);
+    new_controller->left_stick.avg_y =
+            -sdl_thumb_stick_resolve_deadzone_normalize(
+                left_stick_y, left_thumb_norm_deadzone);
+    new_controller->right_stick.avg_x =
+            sdl_thumb_stick_resolve_deadzone_normalize(
+                right_stick_x, right_thumb_norm_deadzone);
+    new_controller->right_stick.avg_y =
+            -sdl_thumb_stick_resolve_deadzone_normalize(
+                right_stick_y, right_thumb_norm_deadzone);
+}
+
+// --late-stick-sample: sticks move continuously, so a catch up step that
+// runs after other steps gets a fresher position by reading them again;
+// buttons stay as read at the top of the frame so no transition is lost.
+// sample_counter stays the frame's read time, only stick changes found here
+// are stamped with this read.
+internal void sdl_resample_controller_sticks(game_input *input,
+                                             sdl_game_controllers *controllers,
+                                             real32 left_thumb_norm_deadzone,
+                                             real32 right_thumb_norm_deadzone)
+{
+    // the controller subsystem may not be up yet, see sdl_continue_startup
+    if (SDL_WasInit(SDL_INIT_GAMECONTROLLER))
+    {
+        SDL_GameControllerUpdate();
+    }
+    uint64_t stick_counter = read_timer(&g_timer);
+    for (uint32_t slot = 0;
+         slot < array_length(controllers->controllers);
+         ++slot)
+    {
+        SDL_GameController *sdl_controller = controllers->controllers[slot];
+        if (sdl_controller)
+        {
+            // controller 0 is reserved for keyboard
+            int32_t controller_index = static_cast<int32_t>(slot) + 1;
+            game_controller_input *controller =
+                    get_controller(input, controller_index);
+            game_controller_input before = *controller;
+            sdl_read_controller_sticks(controller, sdl_controller,
+                                       left_thumb_norm_deadzone,
+                                       right_thumb_norm_deadzone);
+            if (sdl_controller_changed(controller, &before))
+            {
+                sdl_note_input_change(input, controller_index,
+                                      stick_counter);
+            }
+        }
+    }
+}
+
+/*
+  Controller mappings. The build packs gamecontrollerdb.txt for this platform
+  into a GUID hash table, which is mapped here and left in place. Nothing is
+  parsed up front: each joystick's mapping is looked up when it's plugged in
+  and only that one is handed to SDL.
+*/
+
+internal void sdl_init_controllers(sdl_game_controllers *controllers,
+                                   const char *mapping_file)
+{
+    platform_file_view db = platform_map_file(mapping_file, false);
+    if (!db.content || !hcdb_is_valid(db.content, db.size))
+    {
+        printf("No controller mapping database at %s, "
+               "only SDL's built in mappings\n", mapping_file);
+        platform_unmap_file(&db);
+        return;
+    }
+    const hcdb_header *header = static_cast<const hcdb_header*>(db.content);
+    if (std::strcmp(header->platform, SDL_GetPlatform()) != 0)
+    {
+        printf("Controller mappings are for %s, this is %s\n",
+               header->platform, SDL_GetPlatform());
+    }
+    printf("Controller mapping database has %u mappings\n",
+           header->entry_count);
+    controllers->mapping_db = db;
+    // pads already plugged in come through as SDL_JOYDEVICEADDED and
+    // SDL_CONTROLLERDEVICEADDED events like the ones plugged in later, so
+    // there's no scan here
+}
+
+// joystick_index is the device index SDL_JOYDEVICEADDED carries. Mappings
+// replace SDL's built in one, as loading the whole text file used to. SDL
+// sends SDL_CONTROLLERDEVICEADDED once a pad it didn't know gets a mapping,
+// and pads it did know open after this with the mapping updated.
+internal void sdl_add_controller_mapping(
+    const sdl_game_controllers *controllers, int32_t joystick_index)
+{
+    if (!controllers->mapping_db.content)
+    {
+        return;
+    }
+    SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(joystick_index);
+    const char *mapping = hcdb_find_mapping(controllers->mapping_db.content,
+                                            guid.data);
+    if (!mapping)
+    {
+        // newer SDLs put a name crc in bytes 2 and 3, the database has 0s
+        guid.data[2] = 0;
+        guid.data[3] = 0;
+        mapping = hcdb_find_mapping(controllers->mapping_db.content,
+                                    guid.data);
+    }
+    if (mapping && SDL_GameControllerAddMapping(mapping) < 0)
+    {
+        sdl_log_error("SDL_GameControllerAddMapping");
+    }
+}
+
+// free slot for a pad, the one it had last time if that's free; -1 if full
+internal int32_t sdl_find_controller_slot(
+    const sdl_game_controllers *controllers, SDL_JoystickGUID guid)
+{
+    int32_t result = -1;
+    for (int32_t slot = 0;
+         slot < game_input::max_controller_count - 1;
+         ++slot)
+    {
+        if (controllers->controllers[slot])
+        {
+            continue;
+        }
+        if (controllers->has_guid[slot] &&
+            std::memcmp(&controllers->guids[slot], &guid, sizeof(guid)) == 0)
+        {
+            return slot;
+        }
+        if (result < 0 && !controllers->has_guid[slot])
+        {
+            result = slot;
+        }
+    }
+    if (result < 0)
+    {
+        // only slots other pads were in are left, take the first of them
+        for (int32_t slot = 0;
+             slot < game_input::max_controller_count - 1;
+             ++slot)
+        {
+            if (!controllers->controllers[slot])
+            {
+                result = slot;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+// joystick_index is the device index SDL_CONTROLLERDEVICEADDED carries
+internal void sdl_open_controller(sdl_game_controllers *controllers,
+                                  int32_t joystick_index)
+{
+    SDL_GameController *controller = SDL_GameControllerOpen(joystick_index);
+    if (!controller)
+    {
+        sdl_log_error("SDL_GameControllerOpen");
+        return;
+    }
+    SDL_Joystick *joystick = SDL_GameControllerGetJoystick(controller);
+    HANDMADE_ASSERT(joystick);
+    SDL_JoystickID instance_id = SDL_JoystickInstanceID(joystick);
+    for (int32_t slot = 0;
+         slot < game_input::max_controller_count - 1;
+         ++slot)
+    {
+        if (controllers->controllers[slot] &&
+            controllers->instance_ids[slot] == instance_id)
+        {
+            // already open, the open above only added a reference
+            SDL_GameControllerClose(controller);
+            return;
+        }
+    }
+    SDL_JoystickGUID guid = SDL_JoystickGetGUID(joystick);
+    int32_t slot = sdl_find_controller_slot(controllers, guid);
+    if (slot < 0)
+    {
+        printf("No free slot for joystick %d\n", joystick_index);
+        SDL_GameControllerClose(controller);
+        return;
+    }
+    printf("Joystick %d connected as controller %d\n", joystick_index, slot);
+    controllers->controllers[slot] = controller;
+    controllers->instance_ids[slot] = instance_id;
+    controllers->guids[slot] = guid;
+    controllers->has_guid[slot] = true;
+    for (uint32_t axis = 0;
+         axis < array_length(controllers->axis_raw_values[slot]);
+         ++axis)
+    {
+        controllers->axis_raw_values[slot][axis] = 0;
+    }
 
-    // adjust for deadzone
-    if (val >= 0.0f)
+    controllers->haptics[slot] = nullptr;
+    SDL_Haptic *haptic = SDL_HapticOpenFromJoystick(joystick);
+    if (haptic)
     {
-        val = val < deadzone ? 0.0f : val - deadzone;
+        if (SDL_HapticRumbleInit(haptic) == 0)
+        {
+            controllers->haptics[slot] = haptic;
+        }
+        else
+        {
+            printf("Rumbling not supported by controller %d\n", slot);
+            SDL_HapticClose(haptic);
+        }
     }
     else
     {
-        val = val > -deadzone ? 0.0f : val + deadzone;
+        printf("Haptic not supported by controller %d\n", slot);
     }
-
-    // scale the val for smooth transition outside deadzone
-    // sdl flips y-axis compared to xinput
-    val /= (1.0f - deadzone);
-
-    return val;
 }
 
-internal void sdl_init_controllers(sdl_game_controllers *controllers,
-                          const char* mapping_file)
+// slot of the open pad with instance_id, -1 if there's none
+internal int32_t sdl_find_open_controller(
+    const sdl_game_controllers *controllers, SDL_JoystickID instance_id)
 {
-    // add mapping first
-    // TODO: FixThis!!! always fail
-    int32_t num_mappings = SDL_GameControllerAddMappingsFromFile(mapping_file);
-    if (num_mappings < 0)
-    {
-        printf("SDL_GameControllerAddMappingsFromFile error: %s\n",
-               SDL_GetError());
-    }
-    else
-    {
-        printf("SDL_GameControllerAddMappingsFromFile added %d mappings\n",
-               num_mappings);
-    }
-    // get the number of joysticks detected by SDL
-    int32_t sdl_num_joysticks = SDL_NumJoysticks();
-    if (sdl_num_joysticks >= 0)
+    for (int32_t slot = 0;
+         slot < game_input::max_controller_count - 1;
+         ++slot)
     {
-        printf("sdl num controllers=%d\n", sdl_num_joysticks);
-        int32_t controller_index = 0;
-        for (int32_t joystick_index = 0;
-             joystick_index < sdl_num_joysticks;
-             ++joystick_index)
+        if (controllers->controllers[slot] &&
+            controllers->instance_ids[slot] == instance_id)
         {
-            // check if the joystick has controller support
-            // (with button mapping)
-            if (SDL_IsGameController(joystick_index))
-            {
-                printf("Found supported joystick: %d, controller %d\n",
-                       joystick_index, controller_index);
-                controllers->controllers[controller_index++] =
-                        SDL_GameControllerOpen(joystick_index);
-                if (controller_index == game_input::max_controller_count - 1)
-                {
-                    break;
-                }
-            }
+            return slot;
         }
-        controllers->num_controllers_active = controller_index;
     }
-    else
+    return -1;
+}
+
+// instance_id is what SDL_CONTROLLERDEVICEREMOVED carries
+internal void sdl_close_controller(sdl_game_controllers *controllers,
+                                   SDL_JoystickID instance_id)
+{
+    int32_t slot = sdl_find_open_controller(controllers, instance_id);
+    if (slot >= 0)
     {
-        printf("SDL_NumJoysticks error: %s. No controller support.\n",
-               SDL_GetError());
+        printf("Controller %d disconnected\n", slot);
+        if (controllers->haptics[slot])
+        {
+            SDL_HapticClose(controllers->haptics[slot]);
+            controllers->haptics[slot] = nullptr;
+        }
+        SDL_GameControllerClose(controllers->controllers[slot]);
+        controllers->controllers[slot] = nullptr;
     }
+}
 
-    // init haptic
-    for (int32_t controller_index = 0;
-         controller_index < controllers->num_controllers_active;
-         ++controller_index)
+// SDL's buttons in game_controller_input::buttons order
+global_variable const SDL_GameControllerButton kSdlControllerButtons[] = {
+    SDL_CONTROLLER_BUTTON_DPAD_UP,
+    SDL_CONTROLLER_BUTTON_DPAD_DOWN,
+    SDL_CONTROLLER_BUTTON_DPAD_LEFT,
+    SDL_CONTROLLER_BUTTON_DPAD_RIGHT,
+    SDL_CONTROLLER_BUTTON_Y,
+    SDL_CONTROLLER_BUTTON_A,
+    SDL_CONTROLLER_BUTTON_X,
+    SDL_CONTROLLER_BUTTON_B,
+    SDL_CONTROLLER_BUTTON_LEFTSHOULDER,
+    SDL_CONTROLLER_BUTTON_RIGHTSHOULDER,
+    SDL_CONTROLLER_BUTTON_START,
+    SDL_CONTROLLER_BUTTON_BACK,
+};
+
+static_assert(array_length(kSdlControllerButtons) ==
+              sizeof(game_controller_input::buttons) /
+              sizeof(game_button_state),
+              "every game button needs an SDL button");
+
+// ended_down bits for process_button_masks
+internal uint16_t sdl_get_controller_button_mask(
+    SDL_GameController *controller)
+{
+    uint32_t mask = 0;
+    for (uint32_t button_index = 0;
+         button_index < array_length(kSdlControllerButtons);
+         ++button_index)
     {
-        SDL_Joystick *joystick = SDL_GameControllerGetJoystick(
-            controllers->controllers[controller_index]);
-        HANDMADE_ASSERT(joystick);
-        SDL_Haptic *haptic = SDL_HapticOpenFromJoystick(joystick);
-        if (haptic)
+        if (SDL_GameControllerGetButton(controller,
+                                        kSdlControllerButtons[button_index]))
         {
-            printf("Haptic supported by controller %d\n", controller_index);
-            if (SDL_HapticRumbleInit(haptic) == 0)
-            {
-                printf("Rumbling supported\n");
-                controllers->haptics[controller_index] = haptic;
-            }
-            else
-            {
-                printf("Rumbling not supported\n");
-                SDL_HapticClose(haptic);
-            }
+            mask |= 1u << button_index;
         }
-        else
+    }
+    return static_cast<uint16_t>(mask);
+}
+
+// index into game_controller_input::buttons, -1 for buttons the game
+// doesn't use
+internal int32_t sdl_get_game_button_index(SDL_GameControllerButton button)
+{
+    for (uint32_t button_index = 0;
+         button_index < array_length(kSdlControllerButtons);
+         ++button_index)
+    {
+        if (kSdlControllerButtons[button_index] == button)
         {
-            printf("Haptic not supported by controller %d\n", controller_index);
+            return static_cast<int32_t>(button_index);
         }
     }
+    return -1;
 }
 
-internal void sdl_process_controller_digital_button(
-    game_button_state *new_state,
-    const game_button_state *old_state,
-    SDL_GameController *controller, SDL_GameControllerButton button)
+// seconds from frame_begin_counter to an event's SDL timestamp, 0 when
+// there's no frame begin yet
+internal real32 sdl_get_event_frame_time(uint32_t event_ms,
+                                         uint64_t frame_begin_counter)
 {
-    new_state->ended_down = SDL_GameControllerGetButton(controller, button);
-    int32_t transition_amount =
-            (old_state->ended_down != new_state->ended_down) ? 1 : 0;
-    new_state->num_half_transition =
-            old_state->num_half_transition + transition_amount;
+    uint64_t counter = sdl_get_event_counter(event_ms);
+    if (!frame_begin_counter || counter <= frame_begin_counter)
+    {
+        return 0.0f;
+    }
+    return static_cast<real32>(
+        ticks_to_ns(&g_timer, counter - frame_begin_counter)) / 1e9f;
 }
 
-internal void sdl_process_kbd_msg(game_button_state *new_state, bool32 is_down)
+internal void sdl_process_kbd_msg(game_input *input,
+                                  game_button_state *new_state,
+                                  bool32 is_down, real32 time)
 {
     HANDMADE_ASSERT(is_down != new_state->ended_down);
     new_state->ended_down = is_down;
     ++new_state->num_half_transition;
+    const game_controller_input *kbd_controller =
+            get_controller(input, game_input::kbd_controller_index);
+    push_input_event(input, game_input_event_button,
+                     game_input::kbd_controller_index,
+                     static_cast<uint32_t>(new_state -
+                                           kbd_controller->buttons),
+                     is_down ? 1.0f : 0.0f, time);
+}
+
+// a raw SDL stick value as the game sees it on axis
+internal real32 sdl_normalize_stick_axis(
+    const sdl_game_controllers *controllers, game_input_axis axis, int16_t raw)
+{
+    bool32 is_left = axis == game_input_axis_left_x ||
+            axis == game_input_axis_left_y;
+    real32 value = sdl_thumb_stick_resolve_deadzone_normalize(
+        static_cast<real32>(raw),
+        is_left ? controllers->left_stick_deadzone :
+        controllers->right_stick_deadzone);
+    // SDL stick's Y has opposite sign than XInput
+    bool32 is_y = axis == game_input_axis_left_y ||
+            axis == game_input_axis_right_y;
+    return is_y ? -value : value;
+}
+
+internal void sdl_process_controller_axis(game_input *input,
+                                          sdl_game_controllers *controllers,
+                                          const SDL_ControllerAxisEvent *event,
+                                          real32 time)
+{
+    int32_t slot = sdl_find_open_controller(controllers, event->which);
+    if (slot < 0)
+    {
+        return;
+    }
+    game_input_axis axis;
+    switch (event->axis)
+    {
+    case SDL_CONTROLLER_AXIS_LEFTX:
+        {
+            axis = game_input_axis_left_x;
+        }
+        break;
+    case SDL_CONTROLLER_AXIS_LEFTY:
+        {
+            axis = game_input_axis_left_y;
+        }
+        break;
+    case SDL_CONTROLLER_AXIS_RIGHTX:
+        {
+            axis = game_input_axis_right_x;
+        }
+        break;
+    case SDL_CONTROLLER_AXIS_RIGHTY:
+        {
+            axis = game_input_axis_right_y;
+        }
+        break;
+    default:
+        {
+            // triggers, the game has none
+            return;
+        }
+    }
+    int16_t *last_raw = &controllers->axis_raw_values[slot][axis];
+    if (event->value == *last_raw)
+    {
+        return;
+    }
+    real32 last_value = sdl_normalize_stick_axis(controllers, axis, *last_raw);
+    real32 value = sdl_normalize_stick_axis(controllers, axis, event->value);
+    *last_raw = event->value;
+    // moves within the deadzone come out the same 0, bit for bit
+    if (std::memcmp(&value, &last_value, sizeof(value)) != 0)
+    {
+        // controller 0 is reserved for keyboard
+        push_input_event(input, game_input_event_axis, slot + 1, axis, value,
+                         time);
+    }
 }
 
-internal void sdl_process_event(game_controller_input *kbd_controller)
+// frame_begin_counter is when the input the previous game update saw was
+// read, event times are from there
+internal void sdl_process_event(game_input *input,
+                                sdl_game_controllers *controllers,
+                                uint64_t frame_begin_counter)
 {
+    game_controller_input *kbd_controller =
+            get_controller(input, game_input::kbd_controller_index);
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
@@ -621,6 +3759,50 @@ internal void sdl_process_event(game_controller_input *kbd_controller)
                 g_running = false;
             }
             break;
+        case SDL_JOYDEVICEADDED:
+            {
+                sdl_add_controller_mapping(controllers, event.jdevice.which);
+            }
+            break;
+        case SDL_CONTROLLERDEVICEADDED:
+            {
+                sdl_open_controller(controllers, event.cdevice.which);
+            }
+            break;
+        case SDL_CONTROLLERDEVICEREMOVED:
+            {
+                sdl_close_controller(controllers, event.cdevice.which);
+            }
+            break;
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            {
+                // the state itself is polled each frame, this is only the
+                // event for the ring
+                int32_t slot = sdl_find_open_controller(controllers,
+                                                        event.cbutton.which);
+                int32_t button_index = sdl_get_game_button_index(
+                    static_cast<SDL_GameControllerButton>(
+                        event.cbutton.button));
+                if (slot >= 0 && button_index >= 0)
+                {
+                    push_input_event(
+                        input, game_input_event_button, slot + 1,
+                        static_cast<uint32_t>(button_index),
+                        event.cbutton.state == SDL_PRESSED ? 1.0f : 0.0f,
+                        sdl_get_event_frame_time(event.cbutton.timestamp,
+                                                 frame_begin_counter));
+                }
+            }
+            break;
+        case SDL_CONTROLLERAXISMOTION:
+            {
+                sdl_process_controller_axis(
+                    input, controllers, &event.caxis,
+                    sdl_get_event_frame_time(event.caxis.timestamp,
+                                             frame_begin_counter));
+            }
+            break;
         case SDL_KEYDOWN:
         case SDL_KEYUP:
             {
@@ -642,68 +3824,83 @@ internal void sdl_process_event(game_controller_input *kbd_controller)
                 // bool32 alt_down = (event.key.keysym.mod & KMOD_ALT) ? true : false;
                 if (is_down != was_down)
                 {
+                    sdl_note_input_change(
+                        input, game_input::kbd_controller_index,
+                        sdl_get_event_counter(event.key.timestamp));
+                    real32 event_time = sdl_get_event_frame_time(
+                        event.key.timestamp, frame_begin_counter);
                     switch (keycode)
                     {
                     case SDLK_w:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->move_up,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->move_up, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_s:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->move_down,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->move_down, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_a:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->move_left,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->move_left, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_d:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->move_right,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->move_right, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_q:
                         {
                             sdl_process_kbd_msg(
-                                &kbd_controller->left_shoulder, is_down);
+                                input, &kbd_controller->left_shoulder, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_e:
                         {
                             sdl_process_kbd_msg(
-                                &kbd_controller->right_shoulder, is_down);
+                                input, &kbd_controller->right_shoulder, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_UP:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->action_up,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->action_up, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_DOWN:
                         {
                             printf("SDLK_DOWN: isdown=%d, wasdown=%d\n",
                                    is_down, was_down);
-                            sdl_process_kbd_msg(&kbd_controller->action_down,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->action_down, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_LEFT:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->action_left,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->action_left, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_RIGHT:
                         {
-                            sdl_process_kbd_msg(&kbd_controller->action_right,
-                                                  is_down);
+                            sdl_process_kbd_msg(
+                                input, &kbd_controller->action_right, is_down,
+                                event_time);
                         }
                         break;
                     case SDLK_ESCAPE:
@@ -721,6 +3918,43 @@ internal void sdl_process_event(game_controller_input *kbd_controller)
                             printf("ENTER\n");
                         }
                         break;
+                    case SDLK_l:
+                        {
+                            if (is_down)
+                            {
+                                sdl_toggle_input_recording(&g_input_recording);
+                            }
+                        }
+                        break;
+#if HANDMADE_INTERNAL_BUILD
+                    case SDLK_F5:
+                        {
+                            if (is_down)
+                            {
+                                sdl_take_game_memory_snapshot(&g_snapshot);
+                            }
+                        }
+                        break;
+                    case SDLK_F9:
+                        {
+                            if (is_down)
+                            {
+                                sdl_restore_game_memory_snapshot(&g_snapshot);
+                            }
+                        }
+                        break;
+#endif // HANDMADE_INTERNAL_BUILD
+#if HANDMADE_DIAGNOSTIC
+                    case SDLK_p:
+                        {
+                            if (is_down)
+                            {
+                                profiler_print_frame(profiler_get_last_frame(),
+                                                     &g_timer);
+                            }
+                        }
+                        break;
+#endif  // HANDMADE_DIAGNOSTIC
                     }
                 }
             }
@@ -758,29 +3992,183 @@ internal void sdl_process_event(game_controller_input *kbd_controller)
     }
 }
 
-// int if_rdtscp() {
-//     unsigned int edx = 0;
+internal void sdl_print_cpu_info(const cpu_info *cpu)
+{
+    printf("cpu: %s %s\n", cpu->vendor, cpu->brand);
+    printf("  simd:%s%s%s%s%s%s%s%s%s%s%s%s%s\n",
+           cpu->has_sse2 ? " sse2" : "", cpu->has_sse3 ? " sse3" : "",
+           cpu->has_ssse3 ? " ssse3" : "", cpu->has_sse41 ? " sse4.1" : "",
+           cpu->has_sse42 ? " sse4.2" : "", cpu->has_popcnt ? " popcnt" : "",
+           cpu->has_avx ? " avx" : "", cpu->has_avx2 ? " avx2" : "",
+           cpu->has_fma ? " fma" : "", cpu->has_bmi2 ? " bmi2" : "",
+           cpu->has_avx512f ? " avx512f" : "",
+           cpu->has_avx512bw ? " avx512bw" : "",
+           cpu->has_avx512vl ? " avx512vl" : "");
+    printf("  tsc: rdtscp %s, invariant %s\n", cpu->has_rdtscp ? "yes" : "no",
+           cpu->has_invariant_tsc ? "yes" : "no");
+    printf("  cache: %u byte lines, L1d %u KB, L2 %u KB, L3 %u KB\n",
+           cpu->cache_line_size, cpu->l1d_cache_size / 1024,
+           cpu->l2_cache_size / 1024, cpu->l3_cache_size / 1024);
+}
+
+internal void sdl_print_timer(const timer_info *timer)
+{
+    if (timer->uses_tsc)
+    {
+        printf("timer: tsc at %.3f GHz\n",
+               static_cast<real64>(timer->ticks_per_sec) / 1e9);
+    }
+    else
+    {
+        printf("timer: os clock, tsc is not invariant\n");
+    }
+}
+
+/*
+  Startup. Only video is up when the first frame is presented; audio comes up
+  after it and controllers a frame later, one subsystem a frame so no single
+  frame takes all of it. The timer finishes calibrating and the cpu and
+  thread layout are printed right after the first present too. --eager-init
+  brings everything up before the first frame instead, to compare. Times are
+  on the os clock from the top of main, the game timer isn't calibrated yet
+  there.
+*/
+
+enum sdl_startup_stage
+{
+    sdl_startup_stage_audio,
+    sdl_startup_stage_controllers,
+    sdl_startup_stage_done,
+};
+
+struct sdl_startup
+{
+    sdl_startup_stage stage;
+    uint64_t begin_ns;
+    // since begin_ns, 0 until reached
+    uint64_t first_frame_ns;
+    uint64_t audio_ns;
+    uint64_t controllers_ns;
+};
 
-//     asm volatile (
-//      "CPUID\n\t"
-//     :
-//      "=d" (edx)
-//     :
-//     "a" (0x80000001)
-//     :
-//      "%rax", "%rcx", "%rdx");  
+global_variable sdl_startup g_startup {};
 
-//     return (edx >> 27) & 0x1;
-// }
+internal uint64_t sdl_get_startup_ns(const sdl_startup *startup)
+{
+    return platform_read_os_clock_ns() - startup->begin_ns;
+}
 
-int main(int, char **)
+internal SDL_AudioDeviceID sdl_start_audio(sdl_startup *startup,
+                                           sdl_sound_output *sound_output)
 {
-    // if (if_rdtscp())
-    // {
-    //     printf("rdtscp\n");
-    // }
-    // else
-    //     printf("no rdtscp\n");
+    SDL_AudioDeviceID audio_dev_id = 0;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0)
+    {
+        audio_dev_id = sdl_init_sound(sound_output);
+    }
+    else
+    {
+        sdl_log_error("SDL_InitSubSystem(SDL_INIT_AUDIO)");
+    }
+    startup->audio_ns = sdl_get_startup_ns(startup);
+    startup->stage = sdl_startup_stage_controllers;
+    return audio_dev_id;
+}
+
+// pads already plugged in show up as events from here on
+internal void sdl_start_controllers(sdl_startup *startup,
+                                    sdl_game_controllers *controllers)
+{
+    if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC) == 0)
+    {
+        sdl_init_controllers(controllers, kSdlControllerMappingFile);
+    }
+    else
+    {
+        sdl_log_error("SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER)");
+    }
+    startup->controllers_ns = sdl_get_startup_ns(startup);
+    startup->stage = sdl_startup_stage_done;
+}
+
+internal void sdl_print_startup(const sdl_startup *startup)
+{
+    printf("startup: first frame %.2f ms, audio %.2f ms, "
+           "controllers %.2f ms\n",
+           static_cast<real64>(startup->first_frame_ns) / 1e6,
+           static_cast<real64>(startup->audio_ns) / 1e6,
+           static_cast<real64>(startup->controllers_ns) / 1e6);
+}
+
+// after every present: notes the first frame, then brings up one deferred
+// subsystem a call until there are none left
+internal void sdl_continue_startup(sdl_startup *startup,
+                                   sdl_sound_output *sound_output,
+                                   SDL_AudioDeviceID *audio_dev_id,
+                                   sdl_game_controllers *controllers)
+{
+    if (!startup->first_frame_ns)
+    {
+        startup->first_frame_ns = sdl_get_startup_ns(startup);
+    }
+    else if (startup->stage == sdl_startup_stage_audio)
+    {
+        // unpinned while SDL starts its threads, see main
+        sdl_pin_current_thread(-1);
+        *audio_dev_id = sdl_start_audio(startup, sound_output);
+        sdl_pin_current_thread(g_thread_layout.main_cpu);
+    }
+    else if (startup->stage == sdl_startup_stage_controllers)
+    {
+        sdl_pin_current_thread(-1);
+        sdl_start_controllers(startup, controllers);
+        sdl_pin_current_thread(g_thread_layout.main_cpu);
+    }
+    else
+    {
+        return;
+    }
+    if (startup->stage == sdl_startup_stage_done)
+    {
+        sdl_print_startup(startup);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_startup.begin_ns = platform_read_os_clock_ns();
+
+    // the first calibration sample; the first frame runs on the os clock and
+    // the second sample is taken once it's presented, instead of spinning here
+    cpu_info cpu {};
+    query_cpu_info(&cpu);
+    timer_calibration calibration {};
+    begin_timer_calibration(&g_timer, &calibration, &cpu);
+
+    sdl_command_line options {};
+    options.affinity_policy = sdl_affinity_policy_physical;
+    if (!sdl_parse_command_line(argc, argv, &options))
+    {
+        return 1;
+    }
+    // the trace writer converts ticks on its own thread, so the timer mustn't
+    // change under it
+    bool32 timer_calibrated = options.eager_init || options.trace_file;
+    if (timer_calibrated)
+    {
+        end_timer_calibration(&g_timer, &calibration);
+    }
+
+    // before any thread starts, they all pin themselves from the layout;
+    // main is pinned only once they have, so threads SDL starts without
+    // pinning themselves don't inherit its cpu
+    sdl_read_cpu_topology(&g_cpu_topology);
+    sdl_plan_thread_layout(&g_cpu_topology, options.affinity_policy,
+                           &g_thread_layout);
+#if HANDMADE_DIAGNOSTIC
+    profiler_name_thread("main");
+#endif  // HANDMADE_DIAGNOSTIC
+
     // printf("page size=%d\n", sysconf(_SC_PAGESIZE));
     
     constexpr int32_t backbuffer_width = 1280;
@@ -788,9 +4176,13 @@ int main(int, char **)
     
     SDL_Window *window = nullptr;
     SDL_Renderer *renderer = nullptr;
+
+#if HANDMADE_ALLOC_CHECK
+    sdl_alloc_check_install_memory_functions();
+#endif  // HANDMADE_ALLOC_CHECK
     
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER |
-                 SDL_INIT_AUDIO | SDL_INIT_HAPTIC) != 0)
+    // the rest comes up in sdl_continue_startup
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
         printf("SDL_Init error: %s\n", SDL_GetError());
         return 1;
@@ -825,6 +4217,19 @@ int main(int, char **)
         return 1;
     }
 
+    sdl_init_display_timing(&g_display_timing, window, options.target_hz);
+
+    // loads fall back to the game thread if this fails
+    sdl_init_loader(&g_loader);
+    // entries run on the game thread as they are added if this fails
+    sdl_init_work_queue(&g_work_queue, &g_thread_layout);
+#if HANDMADE_DIAGNOSTIC
+    if (options.trace_file)
+    {
+        sdl_begin_trace(&g_trace_writer, options.trace_file);
+    }
+#endif  // HANDMADE_DIAGNOSTIC
+
     // init audio
     sdl_sound_output sound_output {};
     sound_output.running_sample_index = 0;
@@ -837,22 +4242,26 @@ int main(int, char **)
     // must be a power of 2, 2048 samples seem to be a popular setting balancing
     // latency and skips (~23.5 fps, 42.67 ms between writes)
     sound_output.sdl_audio_buffer_size_in_samples = 2048;
-    // aim for 1/15th sec latency
-    sound_output.latency_sample_count = sound_output.samples_per_sec / 10;
+    // a callback's worth ahead of the play cursor plus two game frames, so a
+    // late frame doesn't run the ring dry
+    sound_output.latency_sample_count =
+            sound_output.sdl_audio_buffer_size_in_samples +
+            2 * sound_output.samples_per_sec / g_display_timing.game_update_hz;
     sound_output.bytes_per_sample = sizeof(int16_t) * sound_output.num_sound_ch;
     sound_output.ring_buffer.size = sound_output.samples_per_sec *
             sound_output.bytes_per_sample * sound_output.sec_to_buffer;
 
-    SDL_AudioDeviceID audio_dev_id = sdl_init_sound(&sound_output);
-    int16_t *samples = nullptr;
-    bool32 sound_playing = false;
-    if (audio_dev_id > 0)
+    SDL_AudioDeviceID audio_dev_id = 0;
+    if (options.eager_init)
     {
-        // allocate sound buffer sample, this is free automatically when app
-        // terminates make it as large as the total ring buffer size for safety
-        samples = static_cast<int16_t*>(platform_alloc_zeroed(
-            nullptr, sound_output.ring_buffer.size));
+        audio_dev_id = sdl_start_audio(&g_startup, &sound_output);
     }
+    bool32 sound_playing = false;
+    // allocate sound buffer sample, this is free automatically when app
+    // terminates make it as large as the total ring buffer size for safety;
+    // up front even when audio comes up later, so it's there when it does
+    int16_t *samples = static_cast<int16_t*>(platform_alloc_zeroed(
+        nullptr, sound_output.ring_buffer.size));
 
     // input
     game_input input[2] = {};
@@ -861,17 +4270,17 @@ int main(int, char **)
 
     // init game controller
     sdl_game_controllers sdl_controllers {};
-    sdl_init_controllers(&sdl_controllers, kSdlControllerMappingFile);
+    if (options.eager_init)
+    {
+        sdl_start_controllers(&g_startup, &sdl_controllers);
+    }
     // following un-normalized deadzone comes from xinput
     const real32 left_thumb_norm_deadzone =
             sdl_get_controller_stick_normalized_deadzone(7849.0f);
     const real32 right_thumb_norm_deadzone =
             sdl_get_controller_stick_normalized_deadzone(8689.0f);
-
-    /*
-      TODO: may be handle SDL_CONTROLLERDEVICE events for plugged in or out
-      controllers.
-    */
+    sdl_controllers.left_stick_deadzone = left_thumb_norm_deadzone;
+    sdl_controllers.right_stick_deadzone = right_thumb_norm_deadzone;
 
     // game memory
 #if HANDMADE_INTERNAL_BUILD
@@ -882,6 +4291,10 @@ int main(int, char **)
     game_memory memory {};
     memory.permanent_storage_size = megabyte(64ULL);
     memory.transient_storage_size = gigabyte(1ULL);
+    memory.asset_memory_budget = options.asset_memory_budget;
+    memory.work_queue = &g_work_queue;
+    memory.cpu = cpu;
+    memory.timer = g_timer;
     uint64_t total_size = memory.permanent_storage_size +
             memory.transient_storage_size;
     // Guarantee to be allocation granularity (64KB) aligned
@@ -891,16 +4304,69 @@ int main(int, char **)
     memory.permanent_storage = platform_alloc_zeroed(base_memory_ptr, total_size);
     memory.transient_storage = static_cast<int8_t*>(memory.permanent_storage) +
             memory.permanent_storage_size;
+#if HANDMADE_INTERNAL_BUILD
+    if (memory.permanent_storage)
+    {
+        // F5 takes a snapshot, F9 restores it
+        // keep the state the recording was made from when playing it back
+        sdl_init_game_memory_snapshot(&g_snapshot, memory.permanent_storage,
+                                      memory.permanent_storage_size,
+                                      options.playback_file != nullptr);
+    }
+#endif // HANDMADE_INTERNAL_BUILD
     if (g_backbuffer.memory && samples && memory.permanent_storage &&
         memory.transient_storage)
     {
         g_running = true;
+        sdl_pin_current_thread(g_thread_layout.main_cpu);
+
+        sdl_init_fixed_step(&g_fixed_step, options.fixed_step_hz);
+        g_input_recording.game_dt_for_frame = g_fixed_step.step_ns ?
+                g_fixed_step.step_dt : g_display_timing.dt_for_frame;
+        if (options.record_file)
+        {
+            g_running = sdl_begin_input_recording(&g_input_recording,
+                                                  options.record_file);
+        }
+        else if (options.playback_file)
+        {
+            g_running = sdl_begin_input_playback(&g_input_recording,
+                                                 options.playback_file,
+                                                 options.loop_playback);
+        }
 
-        uint64_t last_cycle_count = __rdtsc();
-        auto last_time_point = std::chrono::high_resolution_clock::now();
+        sdl_init_frame_pacer(&g_frame_pacer, &g_timer,
+                             options.unthrottled ?
+                             0 : g_display_timing.game_update_hz);
+        sdl_init_input_latency(&g_input_latency);
+        sdl_init_frame_stats(&g_frame_stats,
+                             kSdlNsPerSec / g_display_timing.game_update_hz,
+                             options.stats_interval_sec * kSdlNsPerSec);
+        if (options.perf_counters)
+        {
+            // on the game thread, the counters only count the thread that
+            // opens them
+            sdl_open_perf_counters(&g_perf_counters);
+        }
+        uint64_t last_counter = read_timer(&g_timer);
+        uint64_t last_frame_ns = 0;
+        // when the input the last game update saw was read, event times are
+        // from there
+        uint64_t consumed_sample_counter = 0;
+        // printed after the first frame, off the path to it
+        bool32 platform_info_printed = false;
+#if HANDMADE_ALLOC_CHECK
+        uint32_t frame_count = 0;
+#endif  // HANDMADE_ALLOC_CHECK
     
         while (g_running)
         {
+#if HANDMADE_ALLOC_CHECK
+            if (frame_count++ == kAllocCheckWarmupFrames)
+            {
+                alloc_check_arm(true);
+            }
+#endif  // HANDMADE_ALLOC_CHECK
             // We don't really need old input for keyboard as all keyboard
             // events are processed by wm msgs. So, just copy the old state.
             game_controller_input *kbd_controller =
@@ -908,7 +4374,15 @@ int main(int, char **)
             *kbd_controller =
                     *get_controller(old_input, game_input::kbd_controller_index);
             
-            sdl_process_event(kbd_controller);
+            for (int32_t controller_index = 0;
+                 controller_index < game_input::max_controller_count;
+                 ++controller_index)
+            {
+                new_input->change_counters[controller_index] = 0;
+            }
+            carry_input_events(new_input, old_input);
+            sdl_process_event(new_input, &sdl_controllers,
+                              consumed_sample_counter);
 
             if (!g_running)
             {
@@ -916,122 +4390,56 @@ int main(int, char **)
             }
             // game frame
 
-            // poll game controller input
+            // poll game controller input, buttons of every pad go through
+            // as one mask each
+            new_input->sample_counter = read_timer(&g_timer);
+            uint16_t down_masks[game_input::max_controller_count] = {};
             for (int32_t controller_index = 0;
                  controller_index < game_input::max_controller_count - 1;
                  ++controller_index)
             {
                 // controller 0 is reserved for keyboard
+                int32_t true_controller_index = controller_index + 1;
+                SDL_GameController *sdl_controller =
+                        sdl_controllers.controllers[controller_index];
+                if (sdl_controller)
+                {
+                    game_controller_input *new_controller =
+                            get_controller(new_input, true_controller_index);
+                    down_masks[true_controller_index] =
+                            sdl_get_controller_button_mask(sdl_controller);
+                    // process analog
+                    new_controller->is_analog = true;
+                    sdl_read_controller_sticks(new_controller, sdl_controller,
+                                               left_thumb_norm_deadzone,
+                                               right_thumb_norm_deadzone);
+                }
+            }
+            process_button_masks(new_input, old_input, down_masks, 1);
+            for (int32_t controller_index = 0;
+                 controller_index < game_input::max_controller_count - 1;
+                 ++controller_index)
+            {
                 int32_t true_controller_index = controller_index + 1;
                 game_controller_input *new_controller =
                         get_controller(new_input, true_controller_index);
-                if (controller_index < sdl_controllers.num_controllers_active)
+                if (sdl_controllers.controllers[controller_index])
                 {
                     // Controller is connected
                     new_controller->is_connected = true;
-                    const game_controller_input *old_controller =
-                            get_controller(old_input, true_controller_index);
-                    SDL_GameController *sdl_controller =
-                            sdl_controllers.controllers[controller_index];
-
-                    // these are what we care about
-                    sdl_process_controller_digital_button(
-                        &new_controller->move_up,
-                        &old_controller->move_up,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_DPAD_UP);
-                    sdl_process_controller_digital_button(
-                        &new_controller->move_down,
-                        &old_controller->move_down,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_DPAD_DOWN);
-                    sdl_process_controller_digital_button(
-                        &new_controller->move_left,
-                        &old_controller->move_left,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_DPAD_LEFT);
-                    sdl_process_controller_digital_button(
-                        &new_controller->move_right,
-                        &old_controller->move_right,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_DPAD_RIGHT);
-
-                    sdl_process_controller_digital_button(
-                        &new_controller->action_up,
-                        &old_controller->action_up,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_Y);
-                    sdl_process_controller_digital_button(
-                        &new_controller->action_down,
-                        &old_controller->action_down,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_A);
-                    sdl_process_controller_digital_button(
-                        &new_controller->action_left,
-                        &old_controller->action_left,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_X);
-                    sdl_process_controller_digital_button(
-                        &new_controller->action_right,
-                        &old_controller->action_right,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_B);
-
-                    sdl_process_controller_digital_button(
-                        &new_controller->left_shoulder,
-                        &old_controller->left_shoulder,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_LEFTSHOULDER);
-                    sdl_process_controller_digital_button(
-                        &new_controller->right_shoulder,
-                        &old_controller->right_shoulder,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);
-
-                    sdl_process_controller_digital_button(
-                        &new_controller->start,
-                        &old_controller->start,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_START);
-                    sdl_process_controller_digital_button(
-                        &new_controller->back,
-                        &old_controller->back,
-                        sdl_controller,
-                        SDL_CONTROLLER_BUTTON_BACK);
-                
-                    // process analog
-                    new_controller->is_analog = true;
-
-                    // SDL stick's Y has opposite sign than XInput
-                    real32 left_stick_x = static_cast<real32>(
-                        SDL_GameControllerGetAxis(sdl_controller,
-                                                  SDL_CONTROLLER_AXIS_LEFTX));
-                    real32 left_stick_y = static_cast<real32>(
-                        SDL_GameControllerGetAxis(sdl_controller,
-                                                  SDL_CONTROLLER_AXIS_LEFTY));
-                    real32 right_stick_x = static_cast<real32>(
-                        SDL_GameControllerGetAxis(sdl_controller,
-                                                  SDL_CONTROLLER_AXIS_RIGHTX));
-                    real32 right_stick_y = static_cast<real32>(
-                        SDL_GameControllerGetAxis(sdl_controller,
-                                                  SDL_CONTROLLER_AXIS_RIGHTY));
-
-                    new_controller->left_stick.avg_x =
-                            sdl_thumb_stick_resolve_deadzone_normalize(
-                                left_stick_x, left_thumb_norm_deadzone);
-                    new_controller->left_stick.avg_y =
-                            -sdl_thumb_stick_resolve_deadzone_normalize(
-                                left_stick_y, left_thumb_norm_deadzone);
-                    new_controller->right_stick.avg_x =
-                            sdl_thumb_stick_resolve_deadzone_normalize(
-                                right_stick_x, right_thumb_norm_deadzone);
-                    new_controller->right_stick.avg_y =
-                            -sdl_thumb_stick_resolve_deadzone_normalize(
-                                right_stick_y, right_thumb_norm_deadzone);
+                    if (sdl_controller_changed(
+                            new_controller,
+                            get_controller(old_input, true_controller_index)))
+                    {
+                        sdl_note_input_change(new_input, true_controller_index,
+                                              new_input->sample_counter);
+                    }
                 }
                 else
                 {
-                    // Controller is not connected
+                    // Controller is not connected, nothing stays held down
+                    // from before it was pulled out
+                    *new_controller = {};
                     new_controller->is_connected = false;
                 }
             }
@@ -1089,19 +4497,75 @@ int main(int, char **)
                 game_sound_buffer.samples_per_sec = sound_output.samples_per_sec;
             }
 
+            uint32_t step_count = 1;
+            real32 alpha = 1.0f;
+            if (g_fixed_step.step_ns)
+            {
+                step_count = sdl_advance_fixed_step(&g_fixed_step,
+                                                    last_frame_ns);
+                alpha = sdl_get_fixed_step_alpha(&g_fixed_step);
+            }
+
+            sdl_begin_perf_stage(&g_perf_counters);
+            for (uint32_t step_index = 0;
+                 step_index < step_count && g_running;
+                 ++step_index)
+            {
+                // the first step runs right after the poll, later ones have
+                // a whole step's work since
+                if (options.late_stick_sample && step_index > 0)
+                {
+                    sdl_resample_controller_sticks(new_input, &sdl_controllers,
+                                                   left_thumb_norm_deadzone,
+                                                   right_thumb_norm_deadzone);
+                }
+                new_input->dt_for_frame = g_input_recording.game_dt_for_frame;
+                if (g_input_recording.mode == sdl_input_recording_mode_record)
+                {
+                    sdl_record_input(&g_input_recording, new_input);
+                }
+                else if (g_input_recording.mode ==
+                         sdl_input_recording_mode_playback)
+                {
+                    if (!sdl_playback_input(&g_input_recording, new_input) &&
+                        options.playback_file)
+                    {
+                        // playback from the command line is a benchmark run
+                        g_running = false;
+                    }
+                }
+                if (g_running)
+                {
+                    game_update(&memory, new_input);
+                    // catch up steps after the first don't see the frame's
+                    // transitions and events again; a frame with no step
+                    // keeps them, the next frame's input adds to them
+                    consume_input_transitions(new_input);
+                    consumed_sample_counter = new_input->sample_counter;
+                }
+            }
+            if (!g_running)
+            {
+                break;
+            }
+
             game_offscreen_buffer buffer {};
             buffer.width = g_backbuffer.width;
             buffer.height = g_backbuffer.height;
             buffer.pitch = g_backbuffer.pitch;
             buffer.memory = g_backbuffer.memory;
 
-            game_update_and_render(&memory, &buffer, &game_sound_buffer,
-                                   new_input);
+            game_render(&memory, &buffer, &game_sound_buffer, alpha);
+            sdl_end_perf_stage(&g_perf_counters,
+                               sdl_perf_stage_update_and_render);
 
             if (bytes_to_write > 0)
             {
+                TIMED_BLOCK("sdl_fill_sound_buffer");
+                sdl_begin_perf_stage(&g_perf_counters);
                 sdl_fill_sound_buffer(&sound_output, &game_sound_buffer,
                                       byte_to_lock, bytes_to_write);
+                sdl_end_perf_stage(&g_perf_counters, sdl_perf_stage_sound);
                 // printf("bytes written=%" PRIuS "\n", bytes_to_write);
             }
         
@@ -1120,43 +4584,122 @@ int main(int, char **)
             // }
         
             // SDL_RenderClear(renderer);
-            SDL_UpdateTexture(g_backbuffer.texture, nullptr,
-                              g_backbuffer.memory,
-                              static_cast<int32_t>(g_backbuffer.pitch));
-            SDL_RenderCopy(renderer, g_backbuffer.texture, nullptr, nullptr);
-            SDL_RenderPresent(renderer);
+            {
+                TIMED_BLOCK("SDL_UpdateTexture");
+                sdl_begin_perf_stage(&g_perf_counters);
+                SDL_UpdateTexture(g_backbuffer.texture, nullptr,
+                                  g_backbuffer.memory,
+                                  static_cast<int32_t>(g_backbuffer.pitch));
+                sdl_end_perf_stage(&g_perf_counters,
+                                   sdl_perf_stage_update_texture);
+            }
+            {
+                TIMED_BLOCK("SDL_RenderPresent");
+                sdl_begin_perf_stage(&g_perf_counters);
+                SDL_RenderCopy(renderer, g_backbuffer.texture, nullptr,
+                               nullptr);
+                SDL_RenderPresent(renderer);
+                sdl_end_perf_stage(&g_perf_counters, sdl_perf_stage_present);
+            }
+            sdl_record_input_latency(&g_input_latency, new_input,
+                                     read_timer(&g_timer));
+            sdl_continue_startup(&g_startup, &sound_output, &audio_dev_id,
+                                 &sdl_controllers);
+            if (!platform_info_printed)
+            {
+                if (!timer_calibrated)
+                {
+                    // onto the tsc now the first frame is up; the counters
+                    // kept across frames were read on the os clock
+                    end_timer_calibration(&g_timer, &calibration);
+                    last_counter = rebase_os_clock_ticks(&g_timer, &calibration,
+                                                         last_counter);
+                    if (consumed_sample_counter)
+                    {
+                        consumed_sample_counter = rebase_os_clock_ticks(
+                            &g_timer, &calibration, consumed_sample_counter);
+                    }
+                    memory.timer = g_timer;
+                    sdl_init_frame_pacer(&g_frame_pacer, &g_timer,
+                                         options.unthrottled ?
+                                         0 : g_display_timing.game_update_hz);
+                    timer_calibrated = true;
+                }
+                sdl_print_cpu_info(&cpu);
+                sdl_print_timer(&g_timer);
+                sdl_print_thread_layout(&g_cpu_topology, &g_thread_layout);
+                platform_info_printed = true;
+            }
 
             // swap game input
             game_input *tmp_input = new_input;
             new_input = old_input;
             old_input = tmp_input;
 
-            // profiling
-            uint64_t end_cycle_count = __rdtsc();
-            auto end_time_point = std::chrono::high_resolution_clock::now();
-
-            // use signed, as it may go backward
-            int64_t cycles_elapsed =
-                    static_cast<int64_t>(end_cycle_count - last_cycle_count);
-            real32 mega_cycles_per_frame = static_cast<real32>(cycles_elapsed)
-                    / 1000000.0f;
-
-            real32 ms_per_frame = std::chrono::duration_cast<chrono_duration_ms>(
-                end_time_point - last_time_point).count();
-            real32 fps = 1000.0f / ms_per_frame;
-
-            // printf("%.2f Mc/f, %.2f ms/f, %.2f fps\n",
-            //        mega_cycles_per_frame, ms_per_frame, fps);
+            if (g_frame_pacer.target_frame_ticks)
+            {
+                sdl_wait_for_frame_end(&g_frame_pacer, &g_timer,
+                                       last_counter +
+                                       g_frame_pacer.target_frame_ticks);
+            }
 
-            last_cycle_count = end_cycle_count;
-            last_time_point = end_time_point;
+            // profiling
+            uint64_t end_counter = read_timer(&g_timer);
+            uint64_t frame_ns = ticks_to_ns(&g_timer,
+                                            end_counter - last_counter);
+            sdl_end_perf_frame(&g_perf_counters);
+            sdl_record_vblanks(&g_display_timing, frame_ns);
+            if (sdl_record_frame_time(&g_frame_stats, frame_ns))
+            {
+                sdl_print_perf_totals(&g_perf_counters,
+                                      &g_perf_counters.interval);
+                g_perf_counters.interval = {};
+            }
+            last_counter = end_counter;
+            last_frame_ns = frame_ns;
+#if HANDMADE_DIAGNOSTIC
+            profiler_end_frame();
+            sdl_flush_trace(&g_trace_writer);
+#endif  // HANDMADE_DIAGNOSTIC
         }
+        sdl_print_frame_histogram("all frames", &g_frame_stats.total,
+                                  g_frame_stats.missed_count,
+                                  g_frame_stats.deadline_ns);
+        sdl_print_input_latency(&g_input_latency);
+        sdl_print_perf_totals(&g_perf_counters, &g_perf_counters.total);
+        sdl_print_frame_pacer(&g_frame_pacer);
+        sdl_print_fixed_step(&g_fixed_step);
+        sdl_print_display_timing(&g_display_timing);
+#if HANDMADE_ALLOC_CHECK
+        alloc_check_arm(false);
+        alloc_check_print_summary();
+#endif  // HANDMADE_ALLOC_CHECK
+#if HANDMADE_DIAGNOSTIC
+        platform_work_queue_stats work_stats =
+                platform_get_work_queue_stats(&g_work_queue);
+        printf("jobs: %" PRIu64 " executed, %" PRIu64 " stolen, %u threads\n",
+               work_stats.jobs_executed, work_stats.jobs_stolen,
+               g_work_queue.thread_count);
+#endif  // HANDMADE_DIAGNOSTIC
     }
     else
     {
         // fail to allocate memory, no game.
         printf("Fail to alloc memory to backbuffer, sound buffer, or game memory.\n");
     }
+    if (g_input_recording.mode != sdl_input_recording_mode_off)
+    {
+        sdl_end_input_recording(&g_input_recording);
+    }
+#if HANDMADE_INTERNAL_BUILD
+    sdl_free_game_memory_snapshot(&g_snapshot);
+#endif // HANDMADE_INTERNAL_BUILD
+    sdl_close_perf_counters(&g_perf_counters);
+    sdl_shutdown_work_queue(&g_work_queue);
+    sdl_shutdown_loader(&g_loader);
+#if HANDMADE_DIAGNOSTIC
+    sdl_end_trace(&g_trace_writer);
+#endif  // HANDMADE_DIAGNOSTIC
     sdl_cleanup(window, renderer, g_backbuffer.texture, audio_dev_id,
                 &sdl_controllers);
     return 0;
@@ -129,6 +129,130 @@ internal void win32_free(void *memory)
     VirtualFree(memory, 0, MEM_RELEASE);
 }
 
+internal platform_file_view platform_map_file(const char *filename, bool32)
+{
+    // NOTE: no prefetch, PrefetchVirtualMemory needs Windows 8
+    platform_file_view result {};
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER file_size {};
+        if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY,
+                                                0, 0, nullptr);
+            if (mapping)
+            {
+                result.content = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (result.content)
+                {
+                    result.size = static_cast<uint64_t>(file_size.QuadPart);
+                }
+                // the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+            else
+            {
+                // TODO: logging
+            }
+        }
+        CloseHandle(file);
+    }
+    else
+    {
+        // TODO: logging
+    }
+    return result;
+}
+
+internal void platform_unmap_file(platform_file_view *view)
+{
+    if (view->content)
+    {
+        UnmapViewOfFile(view->content);
+    }
+    *view = {};
+}
+
+// loads run synchronously on push; the Win32 layer is kept single threaded,
+// the threaded loader lives in the SDL layer
+constexpr uint32_t kWin32CompletedLoadCount = 256;
+global_variable void *g_completed_loads[kWin32CompletedLoadCount] = {};
+global_variable uint32_t g_num_completed_loads = 0;
+global_variable uint32_t g_next_completed_load = 0;
+
+internal bool32 platform_push_load(platform_load_proc *proc, void *data)
+{
+    if (g_num_completed_loads == kWin32CompletedLoadCount)
+    {
+        return false;
+    }
+    proc(data);
+    g_completed_loads[g_num_completed_loads++] = data;
+    return true;
+}
+
+internal bool32 platform_pop_completed_load(void **data)
+{
+    if (g_next_completed_load == g_num_completed_loads)
+    {
+        g_next_completed_load = 0;
+        g_num_completed_loads = 0;
+        return false;
+    }
+    *data = g_completed_loads[g_next_completed_load++];
+    return true;
+}
+
+internal uint64_t platform_read_os_clock_ns()
+{
+    local_persist int64_t frequency = 0;
+    if (!frequency)
+    {
+        LARGE_INTEGER result;
+        QueryPerformanceFrequency(&result);
+        frequency = result.QuadPart;
+    }
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    // split so counter * 1e9 can't overflow
+    uint64_t seconds = static_cast<uint64_t>(counter.QuadPart / frequency);
+    uint64_t remainder = static_cast<uint64_t>(counter.QuadPart % frequency);
+    return seconds * 1000000000ULL +
+            remainder * 1000000000ULL / static_cast<uint64_t>(frequency);
+}
+
+// entries run synchronously when added, so there's never work left to
+// complete; the Win32 layer is kept single threaded, the worker threads live
+// in the SDL layer
+struct platform_work_queue
+{
+    uint64_t jobs_executed;
+};
+
+global_variable platform_work_queue g_work_queue {};
+
+internal void platform_add_entry(platform_work_queue *queue,
+                                 platform_work_queue_callback *callback,
+                                 void *data)
+{
+    callback(queue, data);
+    ++queue->jobs_executed;
+}
+
+internal void platform_complete_all_work(platform_work_queue *)
+{
+}
+
+internal platform_work_queue_stats platform_get_work_queue_stats(
+    platform_work_queue *queue)
+{
+    platform_work_queue_stats result {};
+    result.jobs_executed = queue->jobs_executed;
+    return result;
+}
+
 #if HANDMADE_INTERNAL_BUILD
 
 // for debugging only, so just ansi filenames
@@ -252,24 +376,7 @@ internal void win32_load_xinput()
 internal real32 win32_xinput_thumb_resolve_deadzone_normalize(
     real32 val, real32 deadzone)
 {
-    // normalize the input first (-1.0f to 1.0f)
-    // max with -1 because abs(min val) is 1 great then max val
-    val = std::max(-1.0f, val / kXInputMaxStickVal);
-
-    // adjust for deadzone
-    if (val >= 0.0f)
-    {
-        val = val < deadzone ? 0.0f : val - deadzone;
-    }
-    else
-    {
-        val = val > -deadzone ? 0.0f : val + deadzone;
-    }
-
-    // scale the val for smooth transition outside deadzone
-    val /= (1.0f - deadzone);
-
-    return val;
+    return resolve_stick_deadzone(val, kXInputMaxStickVal, deadzone);
 }
 
 internal win32_window_dimension win32_get_window_dimension(HWND hwnd)
@@ -662,11 +769,8 @@ internal void win32_process_xinput_digital_button(game_button_state *new_state,
                                                   const XINPUT_GAMEPAD *pad,
                                                   uint32_t xinput_button_bit)
 {
-    new_state->ended_down = pad->wButtons & xinput_button_bit;
-    int32_t transition_amount =
-            (old_state->ended_down != new_state->ended_down) ? 1 : 0;
-    new_state->num_half_transition = old_state->num_half_transition +
-            transition_amount;
+    process_digital_button(new_state, old_state,
+                           (pad->wButtons & xinput_button_bit) != 0);
 }
 
 internal void win32_process_kbd_msg(game_button_state *new_state, bool32 is_down)
@@ -822,10 +926,6 @@ int32_t CALLBACK wWinMain(
     LPWSTR,     // not using lpCmdLine
     int)        // not using nCmdShow
 {
-    LARGE_INTEGER perf_count_freq_result;
-    QueryPerformanceFrequency(&perf_count_freq_result);
-    int64_t perf_count_freq = perf_count_freq_result.QuadPart;
-    
     win32_load_xinput();
     
     wchar_t *wnd_class_name = L"Handmade Hero Window Class";
@@ -857,6 +957,23 @@ int32_t CALLBACK wWinMain(
     }
 
     win32_resize_backbuffer(&g_backbuffer, 1280, 720);
+
+    // update every vblank, or every few on fast displays; frames aren't
+    // paced to it here yet
+    int32_t refresh_hz = 60;
+    {
+        HDC refresh_dc = GetDC(hwnd);
+        int32_t vrefresh = GetDeviceCaps(refresh_dc, VREFRESH);
+        ReleaseDC(hwnd, refresh_dc);
+        // 0 or 1 means the hardware default rate
+        if (vrefresh > 1)
+        {
+            refresh_hz = vrefresh;
+        }
+    }
+    uint32_t game_update_hz = static_cast<uint32_t>(refresh_hz) /
+            get_vblanks_per_game_update(static_cast<uint32_t>(refresh_hz));
+    real32 dt_for_frame = 1.0f / static_cast<real32>(game_update_hz);
     
     // test sound
     win32_sound_output sound_output {};
@@ -864,7 +981,9 @@ int32_t CALLBACK wWinMain(
     sound_output.num_sound_ch = 2;
     sound_output.samples_per_sec = 48000;
     sound_output.sec_to_buffer = 2;
-    sound_output.latency_sample_count = sound_output.samples_per_sec / 15;
+    // four game frames ahead, 1/15th sec at 60Hz
+    sound_output.latency_sample_count =
+            4 * sound_output.samples_per_sec / game_update_hz;
     sound_output.bytes_per_sample = sizeof(int16_t) * sound_output.num_sound_ch;
     sound_output.sound_buffer_size = sound_output.samples_per_sec *
             sound_output.bytes_per_sample * sound_output.sec_to_buffer;
@@ -910,6 +1029,9 @@ int32_t CALLBACK wWinMain(
     game_memory memory {};
     memory.permanent_storage_size = megabyte(64ULL);
     memory.transient_storage_size = gigabyte(1ULL);
+    memory.work_queue = &g_work_queue;
+    query_cpu_info(&memory.cpu);
+    calibrate_timer(&memory.timer, &memory.cpu);
     uint64_t total_size = memory.permanent_storage_size +
             memory.transient_storage_size;
     // Guarantee to be allocation granularity (64KB) aligned
@@ -924,9 +1046,7 @@ int32_t CALLBACK wWinMain(
     {
         g_running = true;
     
-        uint64_t last_cycle_count = __rdtsc();
-        LARGE_INTEGER last_perf_counter;
-        QueryPerformanceCounter(&last_perf_counter);
+        uint64_t last_counter = read_timer(&memory.timer);
     
         while (g_running)
         {
@@ -1098,6 +1218,7 @@ int32_t CALLBACK wWinMain(
             buffer.pitch = g_backbuffer.pitch;
             buffer.memory = g_backbuffer.memory;
 
+            new_input->dt_for_frame = dt_for_frame;
             game_update_and_render(&memory, &buffer, &game_sound_buffer, new_input);
 
             if (bytes_to_write > 0)
@@ -1117,28 +1238,20 @@ int32_t CALLBACK wWinMain(
             new_input = old_input;
             old_input = tmp_input;
 
-            uint64_t end_cycle_count = __rdtsc();
-            LARGE_INTEGER end_perf_counter;
-            QueryPerformanceCounter(&end_perf_counter);
-
-            // use signed, as it may go backward
-            int64_t cycles_elapsed = end_cycle_count - last_cycle_count;
-            int64_t counter_elapsed = end_perf_counter.QuadPart -
-                    last_perf_counter.QuadPart;
-            real32 mega_cycles_per_frame = static_cast<real32>(cycles_elapsed) /
-                    1000000.0f;
-            real32 ms_per_frame = 1000.0f * static_cast<real32>(counter_elapsed)
-                    / static_cast<real32>(perf_count_freq);
-            real32 fps = static_cast<real32>(perf_count_freq) /
-                    static_cast<real32>(counter_elapsed);
+            uint64_t end_counter = read_timer(&memory.timer);
+            real32 ms_per_frame = ticks_to_ms(&memory.timer,
+                                              end_counter - last_counter);
+            real32 fps = 1000.0f / ms_per_frame;
 
             // char buf[256];
-            // sprintf_s(buf, sizeof(buf), "%.2f Mc/f, %.2f ms/f, %.2f fps\n",
-            //           mega_cycles_per_frame, ms_per_frame, fps);
+            // sprintf_s(buf, sizeof(buf), "%.2f ms/f, %.2f fps\n",
+            //           ms_per_frame, fps);
             // OutputDebugStringA(buf);
 
-            last_perf_counter = end_perf_counter;
-            last_cycle_count = end_cycle_count;
+            last_counter = end_counter;
+#if HANDMADE_DIAGNOSTIC
+            profiler_end_frame();
+#endif  // HANDMADE_DIAGNOSTIC
         }
     }
     else